@@ -56,6 +56,18 @@ struct Array {
 		memcpy(result->data, data, used * sizeof(T));
 		return result;
 	}
+	// Same as 'createCopyShrinkToFit' but returns an empty array rather than NULL if nothing was used.
+	inline Array* createCopyExactSize(AllocatorPool* poolToAllocateNewArrayOn) {
+		Array* result = pushStruct(Array, poolToAllocateNewArrayOn);
+		result->init(used, poolToAllocateNewArrayOn);
+		if (used > 0)
+		{
+			result->allocate();
+			result->used = used;
+			memcpy(result->data, data, used * sizeof(T));
+		}
+		return result;
+	}
 	inline Array* createCopy(s32 newSize, AllocatorPool* poolToAllocateNewArrayOn) {
 		if (used == 0)
 		{
@@ -141,7 +153,8 @@ private:
 		_pool = pool;
 	}
 	inline void allocate() {
-		data = pushArrayStruct(T, size, _pool);
+		// NOTE: Elements are only read once pushed, so skip clearing them.
+		data = pushArrayStructUninitialized(T, size, _pool);
 		assert(data);
 	}
 };
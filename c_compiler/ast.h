@@ -24,13 +24,19 @@ enum AST_Types {
 	AST_STATEMENT,
 };
 
+// Index of a node within its layouts 'nodes' array
+typedef u32 AST_Index;
+#define AST_INDEX_NONE 0xFFFFFFFF
+
 struct AST {
 	// Generic
 	AST_Types type;
 	AST* parent;
 
-	// AST_Block - might need to refactor into own data structure later
-	Array<AST*>* childNodes;
+	// AST_Block - Children are the range [firstChild, firstChild + childCount) of the
+	//			   owning layouts 'edges' array.
+	u32 firstChild;
+	u32 childCount;
 	Array<Token>* variables;
 };
 
@@ -41,7 +47,21 @@ struct AST_Parameters : AST {
 	Array<AST_Expression*>* values;
 };
 
+// NOTE: Every node in a layout is stored flat, rather than each node owning an array of child pointers.
+//		 Nodes are referred to by their index into 'nodes' and each nodes children are a contiguous
+//		 run of indices in 'edges'.
 struct AST_Layout : AST {
+	Array<AST*>* nodes;
+	Array<AST_Index>* edges;
+
+	inline AST_Index getChildIndex(AST* ast, u32 i) {
+		assert(i < ast->childCount);
+		return edges->data[ast->firstChild + i];
+	}
+	inline AST* getNode(AST_Index index) {
+		assert(index < (AST_Index)nodes->used);
+		return nodes->data[index];
+	}
 };
 
 // todo(Jake): Rename to Expression_Token
@@ -51,9 +71,43 @@ struct AST_Expression_Token {
 	AST_Parameters* parameters;
 };
 
+// Expressions are lowered to a small stack based program when parsed so evaluating them doesn't
+// walk the tokens again, literal sub-expressions are folded into constants. See 'lowerExpression'.
+#define AST_PROGRAM_MAX_STACK_SIZE 256
+
+enum AST_Opcode {
+	AST_OPCODE_UNKNOWN = 0,
+	AST_OPCODE_CONSTANT, // Push 'constants[operand]'
+	AST_OPCODE_IDENTIFIER, // Push the value of the variable named 'tokens[operand]'
+	AST_OPCODE_ADD, // Pop 'count' values and push them added left to right, 'tokens[operand]' is the last '+'
+	AST_OPCODE_MULTIPLY, // Pop two values and push the result, 'tokens[operand]' is the operator
+	AST_OPCODE_COND_AND,
+	AST_OPCODE_COND_OR,
+	AST_OPCODE_COND_EQUAL,
+};
+
+struct AST_Instruction {
+	u8 opcode;
+	u8 count;
+	u16 operand;
+};
+
+struct AST_Constant {
+	bool isString;
+	String valueString;
+	f64 valueDouble;
+};
+
+struct AST_Program {
+	Array<AST_Instruction>* instructions;
+	Array<AST_Constant>* constants;
+	s32 stackSize; // Most values on the stack at once
+};
+
 struct AST_Expression : AST {
 	// NOTE(Jake): Is this necessary?
 	Array<AST_Expression_Token>* tokens;
+	AST_Program* program; // NULL if it can only be evaluated token by token, ie. uses backend identifiers
 };
 
 struct AST_Expression_Block : AST {
@@ -94,14 +148,17 @@ struct AST_Identifier : AST_Expression_Token, AST {
 
 struct AST_File : AST {
 	String pathname;
+	u64 contentHash; // Hash of the files contents, used to tell if its outputs need rebuilding
 	Array<AST_Layout>* layouts;
 	Array<AST_ComponentDefinition>* components;
+	String source; // Mapped contents of the file, tokens point into it, see 'freeASTFile'
+	String snapshot; // Mapped AST cache the AST was loaded from, the AST lives in it. NULL if it was parsed.
+	AllocatorPool* pool; // Arena the AST was parsed into if the file has its own, NULL if it's shared
 };
 
 inline AST* setupASTType_(AST* ast, AST_Types type, AllocatorPool* pool)
 {
 	ast->type = type;
-	ast->childNodes = Array<AST*>::create(1024, pool);
 	return ast;
 }
 
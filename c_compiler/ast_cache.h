@@ -0,0 +1,608 @@
+#ifndef AST_CACHE_INCLUDE
+#define AST_CACHE_INCLUDE
+
+#include "ast.h"
+#include "file.h"
+#include "hash_table.h"
+
+// NOTE: Bump this whenever the layout of any AST, CSS or Token struct changes so stale
+//		 snapshots are ignored.
+#define AST_CACHE_VERSION 7
+#define AST_CACHE_MAGIC 0x43545341 // 'ASTC'
+
+//
+// A snapshot is a byte-for-byte copy of the arena a file was parsed into, along with a list of
+// every pointer in it. Loading maps the snapshot and patches each pointer, rather than lexing
+// and parsing the file again.
+//
+// File layout: [ASTCacheHeader][image][ASTCacheRelocation * relocationCount]
+// The image starts with a copy of the AST_File, followed by each chunk of the files arena.
+//
+enum ASTCacheRelocationType {
+	AST_CACHE_RELOCATION_UNKNOWN = 0,
+	AST_CACHE_RELOCATION_IMAGE, // Pointer into the image, value is the offset into the image
+	AST_CACHE_RELOCATION_SOURCE, // Pointer into the files contents, value is the offset into the source
+	AST_CACHE_RELOCATION_PATHNAME, // String that is the files pathname (files with the same contents share a snapshot)
+	AST_CACHE_RELOCATION_NULL, // Only valid for the process that wrote it (ie. Array::_pool)
+	AST_CACHE_RELOCATION_ATOM, // Token that needs its Atom interned again, value is unused
+	AST_CACHE_RELOCATION_FILE_ID, // Token that needs the file ID of this run, value is unused
+};
+
+struct ASTCacheHeader {
+	u32 magic;
+	u32 version;
+	u64 contentHash;
+	u32 sourceLength;
+	u32 pointerSize;
+	u32 imageSize;
+	u32 relocationCount;
+};
+
+struct ASTCacheRelocation {
+	u32 offset; // Offset into the image
+	u32 type;
+	u32 value;
+};
+
+// Seeded with the cache version so each version gets its own keys.
+inline u64 getASTCacheKey(String source)
+{
+	return hashString64(source, AST_CACHE_VERSION);
+}
+
+// Returns an empty string if the path doesn't fit in 'buffer', the file is then not cached.
+inline internal String getASTCachePath(char* buffer, s32 bufferSize, String cacheDirectory, u64 key, const char* extension)
+{
+	String result = {};
+	s32 length = snprintf(buffer, bufferSize, "%.*s/%016llx%s", cacheDirectory.length, cacheDirectory.data, (unsigned long long)key, extension);
+	if (length < 0 || length >= bufferSize)
+	{
+		return result;
+	}
+	result.data = buffer;
+	result.length = length;
+	return result;
+}
+
+//
+// Writing
+//
+struct ASTCacheRegion {
+	char* base;
+	memory_index size;
+	u32 imageOffset;
+};
+
+struct ASTCacheWriter {
+	Array<ASTCacheRegion>* regions;
+	Array<ASTCacheRelocation>* relocations;
+	String source;
+	String pathname;
+	bool failed;
+
+	inline bool findImageOffset(void* address, u32* imageOffset)
+	{
+		for (s32 i = 0; i < regions->used; ++i)
+		{
+			ASTCacheRegion* region = &regions->data[i];
+			if ((char*)address >= region->base && (char*)address < region->base + region->size)
+			{
+				*imageOffset = region->imageOffset + (u32)((char*)address - region->base);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline void addRelocation(void* slot, ASTCacheRelocationType type, u32 value)
+	{
+		ASTCacheRelocation relocation;
+		relocation.type = type;
+		relocation.value = value;
+		if (!findImageOffset(slot, &relocation.offset))
+		{
+			// NOTE: Every pointer should live in the files arena, if not, don't cache the file.
+			failed = true;
+			return;
+		}
+		if (relocations->used == relocations->size)
+		{
+			relocations->resize(relocations->size * 2);
+		}
+		relocations->push(relocation);
+	}
+
+	inline void pointer(void* slot)
+	{
+		char* value = *(char**)slot;
+		if (value == NULL)
+		{
+			return;
+		}
+		u32 imageOffset;
+		if (value >= source.data && value <= source.data + source.length)
+		{
+			addRelocation(slot, AST_CACHE_RELOCATION_SOURCE, (u32)(value - source.data));
+		}
+		else if (findImageOffset(value, &imageOffset))
+		{
+			addRelocation(slot, AST_CACHE_RELOCATION_IMAGE, imageOffset);
+		}
+		else
+		{
+			failed = true;
+		}
+	}
+
+	inline void pathnameString(String* string)
+	{
+		if (string->data == pathname.data)
+		{
+			addRelocation(string, AST_CACHE_RELOCATION_PATHNAME, 0);
+		}
+		else
+		{
+			pointer(&string->data);
+		}
+	}
+
+	inline void token(Token* token)
+	{
+		pointer(&token->data);
+		addRelocation(token, AST_CACHE_RELOCATION_FILE_ID, 0);
+		if (token->atom != ATOM_NONE)
+		{
+			addRelocation(token, AST_CACHE_RELOCATION_ATOM, 0);
+		}
+	}
+
+	// Relocates the array itself, returns it so the caller can walk the elements.
+	template <typename T>
+	inline Array<T>* array(Array<T>** slot)
+	{
+		pointer(slot);
+		Array<T>* result = *slot;
+		if (result != NULL)
+		{
+			arrayInPlace(result);
+		}
+		return result;
+	}
+
+	template <typename T>
+	inline void arrayInPlace(Array<T>* array)
+	{
+		pointer(&array->data);
+		if (array->_pool != NULL)
+		{
+			addRelocation(&array->_pool, AST_CACHE_RELOCATION_NULL, 0);
+		}
+	}
+
+	inline void tokens(Array<Token>** slot)
+	{
+		Array<Token>* tokenArray = array(slot);
+		for (s32 i = 0; tokenArray != NULL && i < tokenArray->used; ++i)
+		{
+			token(&tokenArray->data[i]);
+		}
+	}
+
+	inline void ast(AST* ast)
+	{
+		pointer(&ast->parent);
+		tokens(&ast->variables);
+	}
+
+	inline void parameters(AST_Parameters** slot)
+	{
+		pointer(slot);
+		AST_Parameters* parameters = *slot;
+		if (parameters == NULL)
+		{
+			return;
+		}
+		ast(parameters);
+		tokens(&parameters->names);
+		Array<AST_Expression*>* values = array(&parameters->values);
+		for (s32 i = 0; values != NULL && i < values->used; ++i)
+		{
+			pointer(&values->data[i]);
+			expression(values->data[i]);
+		}
+	}
+
+	inline void expression(AST_Expression* expression)
+	{
+		ast(expression);
+		Array<AST_Expression_Token>* exprTokens = array(&expression->tokens);
+		for (s32 i = 0; exprTokens != NULL && i < exprTokens->used; ++i)
+		{
+			AST_Expression_Token* it = &exprTokens->data[i];
+			token(&it->name);
+			parameters(&it->parameters);
+		}
+		pointer(&expression->program);
+		AST_Program* program = expression->program;
+		if (program != NULL)
+		{
+			array(&program->instructions);
+			Array<AST_Constant>* constants = array(&program->constants);
+			for (s32 i = 0; constants != NULL && i < constants->used; ++i)
+			{
+				if (constants->data[i].isString)
+				{
+					pointer(&constants->data[i].valueString.data);
+				}
+			}
+		}
+	}
+
+	inline void layoutNode(AST* node)
+	{
+		switch (node->type)
+		{
+			case AST_IDENTIFIER:
+			{
+				AST_Identifier* it = (AST_Identifier*)node;
+				ast(it);
+				token(&it->name);
+				parameters(&it->parameters);
+				pointer(&it->definition);
+				expression(&it->expression);
+			}
+			break;
+
+			case AST_STATEMENT:
+			{
+				AST_Statement* it = (AST_Statement*)node;
+				ast(it);
+				token(&it->name);
+				token(&it->op);
+				expression(&it->expression);
+			}
+			break;
+
+			case AST_IF:
+			case AST_LOOP:
+			case AST_WHILE:
+			{
+				AST_Expression_Block* it = (AST_Expression_Block*)node;
+				ast(it);
+				expression(&it->expression);
+			}
+			break;
+
+			default:
+				failed = true;
+			break;
+		}
+	}
+
+	inline void layout(AST_Layout* layout)
+	{
+		ast(layout);
+		Array<AST*>* nodes = array(&layout->nodes);
+		for (s32 i = 0; nodes != NULL && i < nodes->used; ++i)
+		{
+			pointer(&nodes->data[i]);
+			layoutNode(nodes->data[i]);
+		}
+		array(&layout->edges);
+	}
+
+	inline void selector(CSS_Selector* selector)
+	{
+		if (selector->type == CSS_SELECTOR_ATTRIBUTE)
+		{
+			token(&selector->attribute.name);
+			token(&selector->attribute.op);
+			token(&selector->attribute.value);
+		}
+		else
+		{
+			token(&selector->token);
+		}
+	}
+
+	inline void rule(CSS_Rule** slot)
+	{
+		pointer(slot);
+		CSS_Rule* it = *slot;
+		if (it == NULL)
+		{
+			return;
+		}
+		pointer(&it->parent);
+		Array<Array<CSS_Selector>>* selectorSets = array(&it->selectorSets);
+		for (s32 i = 0; selectorSets != NULL && i < selectorSets->used; ++i)
+		{
+			Array<CSS_Selector>* selectors = &selectorSets->data[i];
+			arrayInPlace(selectors);
+			for (s32 j = 0; j < selectors->used; ++j)
+			{
+				selector(&selectors->data[j]);
+			}
+		}
+		Array<CSS_Property>* properties = array(&it->properties);
+		for (s32 i = 0; properties != NULL && i < properties->used; ++i)
+		{
+			CSS_Property* property = &properties->data[i];
+			token(&property->name);
+			Array<CSS_PropertyToken>* propTokens = array(&property->tokens);
+			for (s32 j = 0; propTokens != NULL && j < propTokens->used; ++j)
+			{
+				token(&propTokens->data[j].token);
+				tokens(&propTokens->data[j].arguments);
+			}
+		}
+		Array<CSS_Rule*>* childRules = array(&it->childRules);
+		for (s32 i = 0; childRules != NULL && i < childRules->used; ++i)
+		{
+			rule(&childRules->data[i]);
+		}
+	}
+
+	inline void componentDefinition(AST_ComponentDefinition* definition)
+	{
+		ast(definition);
+		token(&definition->name);
+		parameters(&definition->properties);
+		pointer(&definition->layout);
+		if (definition->layout != NULL)
+		{
+			layout(definition->layout);
+		}
+		pointer(&definition->style);
+		if (definition->style != NULL)
+		{
+			ast(definition->style);
+			rule(&definition->style->rule);
+		}
+		Array<AST_ComponentDefinition*>* components = array(&definition->components);
+		for (s32 i = 0; components != NULL && i < components->used; ++i)
+		{
+			pointer(&components->data[i]);
+			componentDefinition(components->data[i]);
+		}
+	}
+
+	inline void file(AST_File* file)
+	{
+		ast(file);
+		pathnameString(&file->pathname);
+		Array<AST_Layout>* layouts = array(&file->layouts);
+		for (s32 i = 0; layouts != NULL && i < layouts->used; ++i)
+		{
+			layout(&layouts->data[i]);
+		}
+		Array<AST_ComponentDefinition>* components = array(&file->components);
+		for (s32 i = 0; components != NULL && i < components->used; ++i)
+		{
+			componentDefinition(&components->data[i]);
+		}
+	}
+};
+
+// Snapshots 'ast_file', every allocation it references must be in 'pool' (aside from the
+// source and pathname). Returns false if the snapshot couldn't be written.
+bool saveASTCache(AST_File* ast_file, String source, String cacheDirectory, AllocatorPool* pool, AllocatorPool* poolTransient)
+{
+	TemporaryPoolScope tempPool(poolTransient);
+
+	ASTCacheWriter writer;
+	zeroMemory(&writer, sizeof(writer));
+	writer.regions = Array<ASTCacheRegion>::create(16, tempPool);
+	writer.relocations = Array<ASTCacheRelocation>::create(1024, tempPool);
+	writer.source = source;
+	writer.pathname = ast_file->pathname;
+
+	// The AST_File goes first, then every chunk of the arena
+	ASTCacheRegion fileRegion;
+	fileRegion.base = (char*)ast_file;
+	fileRegion.size = sizeof(AST_File);
+	fileRegion.imageOffset = 0;
+	writer.regions->push(fileRegion);
+	memory_index imageSize = sizeof(AST_File);
+	for (AllocatorChunk* chunk = pool->chunk; chunk != NULL; chunk = chunk->prev)
+	{
+		if (writer.regions->used == writer.regions->size)
+		{
+			writer.regions->resize(writer.regions->size * 2);
+		}
+		// NOTE: Keep the same alignment within the image that the chunk had in memory
+		imageSize = (imageSize + 15) & ~15;
+		ASTCacheRegion region;
+		region.base = (char*)chunk->base;
+		region.size = (chunk == pool->chunk) ? pool->used : chunk->used;
+		region.imageOffset = (u32)imageSize;
+		writer.regions->push(region);
+		imageSize += region.size;
+	}
+	imageSize = (imageSize + 15) & ~15;
+	if (imageSize > 0x7FFFFFFF)
+	{
+		return false;
+	}
+
+	writer.file(ast_file);
+	if (writer.failed)
+	{
+		return false;
+	}
+
+	memory_index fileSize = sizeof(ASTCacheHeader) + imageSize + (writer.relocations->used * sizeof(ASTCacheRelocation));
+	Buffer buffer((s32)fileSize, tempPool);
+	zeroMemory(buffer.data, fileSize);
+	buffer.used = (s32)fileSize;
+
+	ASTCacheHeader* header = (ASTCacheHeader*)buffer.data;
+	header->magic = AST_CACHE_MAGIC;
+	header->version = AST_CACHE_VERSION;
+	header->contentHash = getASTCacheKey(source);
+	header->sourceLength = source.length;
+	header->pointerSize = sizeof(void*);
+	header->imageSize = (u32)imageSize;
+	header->relocationCount = writer.relocations->used;
+
+	char* image = buffer.data + sizeof(ASTCacheHeader);
+	for (s32 i = 0; i < writer.regions->used; ++i)
+	{
+		ASTCacheRegion* region = &writer.regions->data[i];
+		memcpy(image + region->imageOffset, region->base, region->size);
+	}
+	memcpy(image + imageSize, writer.relocations->data, writer.relocations->used * sizeof(ASTCacheRelocation));
+
+	// Write to a temporary file first so another thread/process never loads a partial snapshot.
+	char tempPath[1024];
+	char cachePath[1024];
+	String temp = getASTCachePath(tempPath, sizeof(tempPath), cacheDirectory, header->contentHash ^ hashString(ast_file->pathname), ".tmp");
+	String path = getASTCachePath(cachePath, sizeof(cachePath), cacheDirectory, header->contentHash, ".ast");
+	if (temp.length == 0 || path.length == 0)
+	{
+		return false;
+	}
+	File::Error error = {};
+	File::writeEntireFile(String::create(tempPath), &buffer, &error);
+	if (error.errorCode)
+	{
+		return false;
+	}
+	remove(path.data);
+	return rename(tempPath, path.data) == 0;
+}
+
+//
+// Loading
+//
+
+// Patches every pointer in a mapped snapshot, checking each against the image and source so a
+// corrupt or truncated snapshot is rejected rather than crashing. Returns false if it's unusable.
+internal bool relocateASTCache(String snapshot, u64 key, String pathname, u16 fileId, String source, AtomTable* atoms)
+{
+	if (snapshot.length < (s32)sizeof(ASTCacheHeader))
+	{
+		return false;
+	}
+	ASTCacheHeader* header = (ASTCacheHeader*)snapshot.data;
+	if (header->magic != AST_CACHE_MAGIC
+		|| header->version != AST_CACHE_VERSION
+		|| header->contentHash != key
+		|| header->sourceLength != (u32)source.length
+		|| header->pointerSize != sizeof(void*)
+		|| header->imageSize < sizeof(AST_File)
+		|| sizeof(ASTCacheHeader) + header->imageSize + (memory_index)header->relocationCount * sizeof(ASTCacheRelocation) != (memory_index)snapshot.length)
+	{
+		return false;
+	}
+
+	char* image = snapshot.data + sizeof(ASTCacheHeader);
+	char* imageEnd = image + header->imageSize;
+	char* sourceEnd = source.data + source.length;
+	ASTCacheRelocation* relocations = (ASTCacheRelocation*)imageEnd;
+	for (u32 i = 0; i < header->relocationCount; ++i)
+	{
+		ASTCacheRelocation* relocation = &relocations[i];
+		memory_index slotSize = sizeof(void*);
+		if (relocation->type == AST_CACHE_RELOCATION_PATHNAME)
+		{
+			slotSize = sizeof(String);
+		}
+		else if (relocation->type == AST_CACHE_RELOCATION_ATOM || relocation->type == AST_CACHE_RELOCATION_FILE_ID)
+		{
+			slotSize = sizeof(Token);
+		}
+		if ((memory_index)relocation->offset + slotSize > header->imageSize)
+		{
+			return false;
+		}
+
+		void** slot = (void**)(image + relocation->offset);
+		switch (relocation->type)
+		{
+			case AST_CACHE_RELOCATION_IMAGE:
+			{
+				if (relocation->value >= header->imageSize)
+				{
+					return false;
+				}
+				*slot = image + relocation->value;
+			}
+			break;
+
+			case AST_CACHE_RELOCATION_SOURCE:
+			{
+				// NOTE: Can point at the null terminator, ie. the EOF token.
+				if (relocation->value > header->sourceLength)
+				{
+					return false;
+				}
+				*slot = source.data + relocation->value;
+			}
+			break;
+
+			case AST_CACHE_RELOCATION_PATHNAME: *(String*)slot = pathname; break;
+			case AST_CACHE_RELOCATION_NULL: *slot = NULL; break;
+			case AST_CACHE_RELOCATION_ATOM:
+			{
+				// NOTE: Its data has already been relocated, as the writer adds that first (see ASTCacheWriter::token)
+				Token* token = (Token*)slot;
+				bool isInSource = token->data >= source.data && token->data <= sourceEnd && token->length <= sourceEnd - token->data;
+				bool isInImage = token->data >= image && token->data <= imageEnd && token->length <= imageEnd - token->data;
+				if (token->length < 0 || (!isInSource && !isInImage))
+				{
+					return false;
+				}
+				// NOTE: Atoms are numbered in the order they're first seen, so they differ between runs.
+				token->atom = atoms->intern(*token);
+			}
+			break;
+
+			case AST_CACHE_RELOCATION_FILE_ID: ((Token*)slot)->fileId = fileId; break;
+
+			default:
+				// Corrupt snapshot
+				return false;
+		}
+	}
+	return true;
+}
+
+// Returns false if there's no usable snapshot for 'source'.
+bool loadASTCache(AST_File* ast_file, String pathname, u16 fileId, String source, String cacheDirectory, AtomTable* atoms)
+{
+	u64 key = getASTCacheKey(source);
+	char cachePath[1024];
+	String path = getASTCachePath(cachePath, sizeof(cachePath), cacheDirectory, key, ".ast");
+	if (path.length == 0)
+	{
+		return false;
+	}
+
+	FILE* f = fopen(path.data, "rb");
+	if (f == NULL)
+	{
+		return false;
+	}
+	fclose(f);
+
+	File::Error error = {};
+	String snapshot = File::mapEntireFile(path, &error, true);
+	if (snapshot.data == NULL)
+	{
+		return false;
+	}
+	if (!relocateASTCache(snapshot, key, pathname, fileId, source, atoms))
+	{
+		File::unmapEntireFile(snapshot);
+		return false;
+	}
+
+	*ast_file = *(AST_File*)(snapshot.data + sizeof(ASTCacheHeader));
+	ast_file->source = source;
+	ast_file->snapshot = snapshot;
+	ast_file->pool = NULL;
+	return true;
+}
+
+#endif
@@ -128,14 +128,31 @@ inline void printStyle(CSS_Rule* rule, AST_Printer* printer)
 	printer->printNewlineAndIndent();
 }
 
+// NOTE: Nodes under a layout refer to their children by index, so track which layout they belong to.
+struct AST_PrintEntry {
+	AST* ast;
+	AST_Layout* layout;
+};
+
+inline void pushPrintEntry(Array<AST_PrintEntry>* stack, AST* ast, AST_Layout* layout)
+{
+	AST_PrintEntry entry;
+	entry.ast = ast;
+	entry.layout = layout;
+	stack->push(entry);
+}
+
 inline void printAST(Compiler* compiler, AST* absoluteTopAST, AST_Printer* printer)
 {
 	TemporaryPoolScope tempPoolScope(compiler->poolTransient);
-	Array<AST*> stack(2048, tempPoolScope);
-	stack.push(absoluteTopAST);
+	Array<AST_PrintEntry> stack(2048, tempPoolScope);
+	AST_PrintEntry entry = {};
+	entry.ast = absoluteTopAST;
+	stack.push(entry);
 	while (stack.used)
 	{
-		AST* top = stack.pop();
+		entry = stack.pop();
+		AST* top = entry.ast;
 	
 		if (top == 0)
 		{
@@ -166,7 +183,7 @@ inline void printAST(Compiler* compiler, AST* absoluteTopAST, AST_Printer* print
 			{
 				AST_Statement* statement = (AST_Statement*)top;
 				print("%s %s", &statement->name, &statement->op);
-				stack.push(&statement->expression);
+				pushPrintEntry(&stack, &statement->expression, NULL);
 			} 
 			break;
 
@@ -196,7 +213,7 @@ inline void printAST(Compiler* compiler, AST* absoluteTopAST, AST_Printer* print
 				AST_Identifier* ast = (AST_Identifier*)top;
 				print("%s", &ast->name);
 				if (ast->parameters != NULL) {
-					stack.push(ast->parameters);
+					pushPrintEntry(&stack, ast->parameters, NULL);
 				}
 			}
 			break;
@@ -271,7 +288,7 @@ inline void printAST(Compiler* compiler, AST* absoluteTopAST, AST_Printer* print
 				print("%s", &ast->name);
 				if (ast->parameters != NULL && ast->parameters->values != NULL && ast->parameters->values->used > 0)
 				{
-					stack.push(ast->parameters);
+					pushPrintEntry(&stack, ast->parameters, NULL);
 				}
 				printf("     (AST_COMP_OR_FUNC)");
 			} 
@@ -283,19 +300,19 @@ inline void printAST(Compiler* compiler, AST* absoluteTopAST, AST_Printer* print
 				// Add in reverse to print in proper order
 				printf("def %*.*s", ast->name.length, ast->name.length, ast->name.data);
 				printer->printNewlineAndIndent(); printf("{");
-				stack.push(NULL); ++printer->indent;
+				pushPrintEntry(&stack, NULL, NULL); ++printer->indent;
 				if (ast->components != NULL)
 				{
 					for (s32 i = ast->components->used - 1; i >= 0; --i)
 					{
-						stack.push(ast->components->data[i]);
+						pushPrintEntry(&stack, ast->components->data[i], NULL);
 					}
 				}
 				if (ast->style != NULL) {
-					stack.push(ast->style);
+					pushPrintEntry(&stack, ast->style, NULL);
 				}
 				if (ast->layout != NULL) {
-					stack.push(ast->layout);
+					pushPrintEntry(&stack, ast->layout, NULL);
 				}
 			}
 			break;
@@ -326,15 +343,17 @@ inline void printAST(Compiler* compiler, AST* absoluteTopAST, AST_Printer* print
 		}
 
 
-		if (top->childNodes != NULL && top->childNodes->used > 0)
+		if (top->childCount > 0)
 		{
+			AST_Layout* layout = (top->type == AST_LAYOUT) ? (AST_Layout*)top : entry.layout;
+			assert(layout != NULL);
 			printer->printNewlineAndIndent();
 			printf("{");
 			// Add in reverse to print in proper order
-			stack.push(NULL); ++printer->indent;
-			for (s32 i = top->childNodes->used - 1; i >= 0; --i)
+			pushPrintEntry(&stack, NULL, NULL); ++printer->indent;
+			for (s32 i = top->childCount - 1; i >= 0; --i)
 			{
-				stack.push(top->childNodes->data[i]);
+				pushPrintEntry(&stack, layout->getNode(layout->getChildIndex(top, i)), layout);
 			}
 		}
 	}
@@ -0,0 +1,102 @@
+#ifndef ATOM_INCLUDE
+#define ATOM_INCLUDE
+
+#include "hash_table.h"
+#include "thread.h"
+
+// Interned identifier, two identifiers with the same name always have the same atom.
+// 0 means the token was not interned (ie. strings, numbers, operators)
+typedef u32 Atom;
+
+// Pre-seeded so the parser/compiler can compare against keywords directly.
+enum AtomKeyword {
+	ATOM_NONE = 0,
+	ATOM_LAYOUT,
+	ATOM_DEF,
+	ATOM_FUNC,
+	ATOM_PROPERTIES,
+	ATOM_STYLE,
+	ATOM_SCRIPT,
+	ATOM_CHILDREN,
+	ATOM_IF,
+	ATOM_LOOP,
+	ATOM_WHILE,
+	ATOM_ELSE,
+	ATOM_WHEN,
+	ATOM_AT_MEDIA,
+
+	ATOM_KEYWORD_COUNT,
+};
+
+#define ATOM_TABLE_SHARD_COUNT 64
+
+// NOTE: Shared by all the parser threads, so the table is split into shards that
+//		 are each locked seperately.
+struct AtomTable {
+	struct Shard {
+		Thread::Mutex mutex;
+		HashTable<Atom>* atoms;
+	};
+
+	Shard shards[ATOM_TABLE_SHARD_COUNT];
+	volatile s32 lastAtom;
+	AllocatorPool* pool; // Only allocate with 'poolMutex' held
+	Thread::Mutex poolMutex;
+
+	static AtomTable* create(AllocatorPool* pool) {
+		AtomTable* result = pushStruct(AtomTable, pool);
+		result->pool = pool;
+		result->poolMutex = Thread::createMutex();
+		for (s32 i = 0; i < ATOM_TABLE_SHARD_COUNT; ++i)
+		{
+			Shard* shard = &result->shards[i];
+			shard->mutex = Thread::createMutex();
+			shard->atoms = HashTable<Atom>::create(256, pool);
+		}
+
+		// NOTE: Must be in the same order as AtomKeyword
+		char* keywords[] = {
+			"layout", "def", "func", "properties", "style", "script", "children",
+			"if", "loop", "while", "else", "when", "@media",
+		};
+		assert(ArrayCount(keywords) == ATOM_KEYWORD_COUNT - 1);
+		for (s32 i = 0; i < (s32)ArrayCount(keywords); ++i)
+		{
+			Atom atom = result->intern(String::create(keywords[i]));
+			assert(atom == (Atom)(i + 1));
+		}
+		return result;
+	}
+
+	// NOTE: The string is copied the first time it's seen, as it usually points into a mapped
+	//		 file that is unmapped or changed when watching.
+	inline Atom intern(String string) {
+		u32 hash = hashString(string);
+		// Use the high bits to pick the shard as the low bits index into the shards table
+		Shard* shard = &shards[(hash >> 26) % ATOM_TABLE_SHARD_COUNT];
+
+		Thread::lock(shard->mutex);
+		Atom* atom = shard->atoms->find(string, hash);
+		if (atom == NULL)
+		{
+			Thread::lock(poolMutex);
+			String key = {};
+			key.length = string.length;
+			key.data = (char*)pushSizeUninitialized(string.length, pool);
+			memcpy(key.data, string.data, string.length);
+			atom = shard->atoms->findOrAdd(key, hash);
+			Thread::unlock(poolMutex);
+			*atom = (Atom)Thread::atomicIncrement(&lastAtom);
+		}
+		Atom result = *atom;
+		Thread::unlock(shard->mutex);
+		return result;
+	}
+
+	// Upper bound for arrays indexed by Atom
+	inline s32 count() {
+		return lastAtom + 1;
+	}
+};
+
+#endif
@@ -3,6 +3,13 @@
 
 #include <stdarg.h>
 #include "print.h"
+#include "array.h"
+
+namespace File
+{
+	struct Stream;
+	void writeStream(Stream* stream, String* parts, s32 partCount);
+}
 
 // http://codereview.stackexchange.com/questions/96354/sample-printf-implementation
 
@@ -11,6 +18,12 @@ struct Buffer {
 	s32 size;
 	char* data;
 	AllocatorPool* _pool;
+	// NOTE: If set, the buffer is written to the stream whenever it fills up rather than
+	//		 asserting, so output can be any size while memory stays at 'size'.
+	File::Stream* stream;
+	// NOTE: If set, the offset of each 'addNewline' is recorded so the output can be indented
+	//		 again later, see printHTMLFragment.
+	Array<s32>* newlines;
 
 	// String helper
 	s32 indent;
@@ -19,6 +32,11 @@ public:
 		zeroMemory(this, sizeof(*this));
 		init(size, pool._allocator);
 	}
+	Buffer(s32 size, TemporaryPool pool, File::Stream* stream) {
+		zeroMemory(this, sizeof(*this));
+		init(size, pool._allocator);
+		this->stream = stream;
+	}
 	inline static Buffer* create(s32 size, AllocatorPool* pool)
 	{
 		Buffer* result = pushStruct(Buffer, pool);
@@ -32,69 +50,194 @@ public:
 	}
 	void addNewline() 
 	{
-		add("\n");
+		if (newlines != NULL)
+		{
+			assert(stream == NULL);
+			if (newlines->used == newlines->size)
+			{
+				newlines->resize(newlines->size * 2);
+			}
+			newlines->push(used);
+		}
+		addIndentation(true);
+	}
+	// Indentation for the current 'indent' level, without a newline.
+	void addIndent()
+	{
+		addIndentation(false);
+	}
+	inline void addIndentation(bool withNewline)
+	{
+		// NOTE: A newline followed by enough indentation for most nesting, so indenting is a single copy.
+		static const char newlineAndIndent[] = "\n"
+			"                                                                                "
+			"                                                                                ";
+		const s32 indentSize = 5;
+		const s32 maxIndent = (sizeof(newlineAndIndent) - 2) / indentSize;
 		assert(indent >= 0);
-		for (s32 i = 0; i < indent; ++i)
+		s32 indentRemaining = indent;
+		String run = {};
+		do
+		{
+			s32 levels = (indentRemaining < maxIndent) ? indentRemaining : maxIndent;
+			run.data = (char*)newlineAndIndent + (withNewline ? 0 : 1);
+			run.length = (withNewline ? 1 : 0) + levels * indentSize;
+			add(run);
+			indentRemaining -= levels;
+			withNewline = false;
+		}
+		while (indentRemaining > 0);
+	}
+	// Write everything added so far to the stream, if there is one.
+	void flush()
+	{
+		if (stream != NULL && used > 0)
 		{
-			add("     ");
+			String part = {};
+			part.data = data;
+			part.length = used;
+			File::writeStream(stream, &part, 1);
+			used = 0;
 		}
 	}
 	inline void add(char character)
 	{
-		char* dataPlusOffset = data + used;
-		char* dataEndPointer = data + size;
-		dataPlusOffset[0] = character;
-		++dataPlusOffset;
-		assert(dataPlusOffset < dataEndPointer);
+		if (used + 1 >= size)
+		{
+			flush();
+		}
+		data[used] = character;
 		++used;
+		assert(used < size);
+	}
+	inline void add(String string)
+	{
+		if (used + string.length >= size)
+		{
+			if (stream != NULL && string.length >= size / 2)
+			{
+				// Write large strings to the stream along with what's buffered rather than copying them.
+				String parts[2];
+				parts[0].data = data;
+				parts[0].length = used;
+				parts[1] = string;
+				File::writeStream(stream, parts, 2);
+				used = 0;
+				return;
+			}
+			flush();
+		}
+		assert(used + string.length < size);
+		memcpy(data + used, string.data, string.length);
+		used += string.length;
+	}
+	// String literals, the length is known at compile time so there's no format to parse.
+	// NOTE: Only for literals, a char array would be copied in full rather than up to its null-terminator.
+	template <s32 N>
+	inline void add(const char (&literal)[N])
+	{
+		String string = {};
+		string.data = (char*)literal;
+		string.length = N - 1;
+		add(string);
 	}
+	inline void addInt(s64 value)
+	{
+		// NOTE: Written backwards from the end of 'digits' so there's no reverse step.
+		char digits[24];
+		char* end = digits + sizeof(digits);
+		char* at = end;
+		u64 magnitude = (value < 0) ? (u64)0 - (u64)value : (u64)value;
+		do
+		{
+			*--at = (char)('0' + (magnitude % 10));
+			magnitude /= 10;
+		}
+		while (magnitude != 0);
+		if (value < 0)
+		{
+			*--at = '-';
+		}
+		String string = {};
+		string.data = at;
+		string.length = (s32)(end - at);
+		add(string);
+	}
+	// Same output as printf's "%f".
+	inline void addDouble(double value)
+	{
+		// NOTE: When the value scaled by 10^6 is a whole number that fits in 31 bits, it's within
+		//		 2^-23 of the exact value so printing it as fixed point rounds the same way "%f" does.
+		//		 Anything else (huge, tiny fractions, NaN, inf) falls back to snprintf.
+		double scaled = value * 1000000.0;
+		if (scaled > -2147483648.0 && scaled < 2147483648.0 && scaled == (double)(s64)scaled)
+		{
+			u64 bits;
+			memcpy(&bits, &value, sizeof(bits));
+			s64 fixed = (s64)scaled;
+			bool isNegative = (bits >> 63) != 0; // Catches -0.0 too
+			if (fixed < 0)
+			{
+				fixed = -fixed;
+			}
+			char digits[24];
+			char* end = digits + sizeof(digits);
+			char* at = end;
+			for (s32 i = 0; i < 6; ++i)
+			{
+				*--at = (char)('0' + (fixed % 10));
+				fixed /= 10;
+			}
+			*--at = '.';
+			do
+			{
+				*--at = (char)('0' + (fixed % 10));
+				fixed /= 10;
+			}
+			while (fixed != 0);
+			if (isNegative)
+			{
+				*--at = '-';
+			}
+			String string = {};
+			string.data = at;
+			string.length = (s32)(end - at);
+			add(string);
+			return;
+		}
+
+		char temp[512];
+		String string = {};
+		string.data = temp;
+		string.length = snprintf(temp, sizeof(temp), "%f", value);
+		if (string.length < 0 || string.length >= (s32)sizeof(temp))
+		{
+			string.length = sizeof(temp) - 1;
+		}
+		add(string);
+	}
+	// Generic formatter, prefer the typed add() calls above in hot paths.
 	void add(char* format, ...)
 	{
 		va_list valist;
 		va_start(valist, format);
-		char* dataPlusOffset = data + used;
-		char* dataEndPointer = data + size;
 		while(format[0] != '\0')
 		{
 			if(format[0] == '%')
 			{
-				char temp[256] = "";
-
 				switch (format[1])
 				{
 					// Non-Decimal Number
 					case 'd':
 					{
-						int	iTemp = va_arg(valist, int);
-						_itoa(iTemp, temp, 10); 
-						s32 tempLength = strlen(temp);
-
-						for(int i = 0; i < tempLength; i++)
-						{
-							assert(dataPlusOffset < dataEndPointer);
-							*dataPlusOffset = temp[i];
-							++dataPlusOffset;
-						}
+						addInt(va_arg(valist, int));
 					}
 					break;
 
 					// Decimal Number
 					case 'f':
 					{
-						#define FLOAT_CHAR_SIZE 50
-						double dTemp = va_arg(valist, double);
-						char output[FLOAT_CHAR_SIZE];
-						snprintf(output, FLOAT_CHAR_SIZE, "%f", dTemp);
-						for(int i = 0; i < FLOAT_CHAR_SIZE; i++)
-						{
-							if (output[i] == '\0') {
-								break;
-							}
-							assert(dataPlusOffset < dataEndPointer);
-							*dataPlusOffset = output[i];
-							++dataPlusOffset;
-						}
-						#undef FLOAT_CHAR_SIZE
+						addDouble(va_arg(valist, double));
 					}
 					break;
 
@@ -104,12 +247,7 @@ public:
 						String* strTemp = va_arg(valist, String*);
 						assert(strTemp->length > 0);
 						assert(strTemp->length < Kilobytes(1)); // NOTE(Jake): Catch unlikely case/Memory problem
-						for (s32 i = 0; i < strTemp->length; ++i)
-						{
-							assert(dataPlusOffset < dataEndPointer);
-							*dataPlusOffset = strTemp->data[i];
-							++dataPlusOffset;
-						}
+						add(*strTemp);
 					}
 					break;
 
@@ -124,14 +262,17 @@ public:
 			}
 			else
 			{
-				assert(dataPlusOffset < dataEndPointer);
-				*dataPlusOffset = format[0];
-				++dataPlusOffset;
-				++format;
+				// Copy everything up to the next format specifier at once
+				String run = {};
+				run.data = format;
+				while (format[0] != '\0' && format[0] != '%')
+				{
+					++format;
+				}
+				run.length = (s32)(format - run.data);
+				add(run);
 			}
 		}
-		assert(dataPlusOffset < dataEndPointer);
-		used = size - (dataEndPointer - dataPlusOffset);
 		va_end(valist);
 	}
 private:
@@ -139,7 +280,7 @@ private:
 		size = allocSize;
 		assert(size > 0);
 		_pool = pool;
-		data = (char*)pushSize(size, pool);
+		data = (char*)pushSizeUninitialized(size, pool);
 		used = 0;
 	}
 };
@@ -3,15 +3,17 @@
 #include "html_print.h"
 #include "css_print.h"
 #include "file.h"
+#include "thread.h"
+#include "dependency_graph.h"
 
 HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, CompilerParameters* properties = NULL);
 CompilerValue evaluateExpression(Compiler* compiler, AST_Expression* expression);
 
-inline AST_ComponentDefinition* findComponentDefinition(Compiler* compiler, String name)
+void buildComponentIndex(Compiler* compiler)
 {
-	TemporaryPoolScope tempPool(compiler->poolTransient);
-	Array<AST_ComponentDefinition*> definitions(256, tempPool);
-
+	// NOTE: Indexed directly by Atom, the atom table can't change after parsing.
+	compiler->componentIndexCount = compiler->atoms->count();
+	compiler->componentIndex = pushArrayStruct(ComponentIndexEntry, compiler->componentIndexCount, compiler->pool);
 	for (s32 i = 0; i < compiler->astFiles->used; ++i)
 	{
 		AST_File* ast_file = &compiler->astFiles->data[i];
@@ -20,39 +22,72 @@ inline AST_ComponentDefinition* findComponentDefinition(Compiler* compiler, Stri
 			for (s32 j = 0; j < ast_file->components->used; ++j)
 			{
 				AST_ComponentDefinition* definition = &ast_file->components->data[j];
-				if (name.cmp(definition->name))
+				assert(definition->name.atom != ATOM_NONE);
+				ComponentIndexEntry* entry = &compiler->componentIndex[definition->name.atom];
+				if (entry->definition == NULL)
+				{
+					entry->definition = definition;
+				}
+				else
 				{
-					definitions.push(definition);
+					// Keep track of every definition to report on if the component is used.
+					if (entry->definitions == NULL)
+					{
+						entry->definitions = Array<AST_ComponentDefinition*>::create(16, compiler->pool);
+						entry->definitions->push(entry->definition);
+					}
+					if (entry->definitions->used == entry->definitions->size)
+					{
+						entry->definitions->resize(entry->definitions->size * 2);
+					}
+					entry->definitions->push(definition);
 				}
 			}
 		}
 	}
+}
 
-	if (definitions.used > 0)
+inline AST_ComponentDefinition* findComponentDefinition(Compiler* compiler, Token name)
+{
+	assert(compiler->componentIndex != NULL);
+	assert(name.atom != ATOM_NONE && name.atom < (Atom)compiler->componentIndexCount);
+	ComponentIndexEntry* entry = &compiler->componentIndex[name.atom];
+	if (entry->definition == NULL)
 	{
-		if (definitions.used == 1)
-		{
-			AST_ComponentDefinition* definition = definitions.data[0];
-			return definition;
-		}
-		else
-		{
-			compiler->hasError = true;
-			// Detect multiple definitions error
-			compileError("Multiple definitions of '%s' found.", &name);
-			for (s32 i = 0; i < definitions.used; ++i)
-			{
-				AST_ComponentDefinition* definition = definitions.data[i];
-				String basename = definition->name.pathName.basename();
-				compileErrorSub("Definition #%d found on Line %d on file '%s'.", i, definition->name.lineNumber, &basename);
-				compileErrorSubSub("(%s)", &definition->name.pathName);
-			}
-		}
+		return NULL;
+	}
+	if (entry->definitions == NULL)
+	{
+		return entry->definition;
 	}
 
+	// Detect multiple definitions error
+	compiler->hasError = true;
+	compileErrorBegin("Multiple definitions of '%s' found.", &name);
+	for (s32 i = 0; i < entry->definitions->used; ++i)
+	{
+		AST_ComponentDefinition* definition = entry->definitions->data[i];
+		String pathname = compiler->filePathnames->data[definition->name.fileId];
+		String basename = pathname.basename();
+		compileErrorSub("Definition #%d found on Line %d on file '%s'.", i, definition->name.lineNumber, &basename);
+		compileErrorSubSub("(%s)", &pathname);
+	}
+	compileErrorEnd();
 	return NULL;
 }
 
+inline void addComponentUsed(Array<AST_ComponentDefinition*>* componentsUsed, AST_ComponentDefinition* definition)
+{
+	if (componentsUsed->find(definition) == -1)
+	{
+		if (componentsUsed->used == componentsUsed->size)
+		{
+			componentsUsed->resize(componentsUsed->size * 2);
+		}
+		componentsUsed->push(definition);
+	}
+}
+
 CompilerValue evaluateIdentifier(Compiler* compiler, Token identifierName, AST_Expression* context)
 {
 	assert(context != NULL);
@@ -73,7 +108,7 @@ CompilerValue evaluateIdentifier(Compiler* compiler, Token identifierName, AST_E
 			assert(stackParameters->names != NULL && stackParameters->names->used > 0);
 			assert(stackParameters->names->used == stackParameters->values->used);
 			
-			s32 findIndex = stackParameters->names->find(identifierName);
+			s32 findIndex = findByAtom(stackParameters->names, identifierName.atom);
 			if (findIndex != -1)
 			{
 				CompilerValue result = stackParameters->values->data[findIndex];
@@ -253,7 +288,7 @@ CompilerValue compute(Compiler* compiler, CompilerValue lval, CompilerValue rval
 	return result;
 }
 
-CompilerValue evaluateExpression(Compiler* compiler, AST_Expression* expression)
+internal CompilerValue evaluateExpressionTokens(Compiler* compiler, AST_Expression* expression)
 {
 	assert(expression != NULL);
 	assert(expression->tokens != NULL);
@@ -499,6 +534,146 @@ CompilerValue evaluateExpression(Compiler* compiler, AST_Expression* expression)
 	return result;
 }
 
+// Runs the program the expression was lowered to when parsed. Returns false if it has to be evaluated
+// token by token instead, ie. a variable holds a backend expression or there's a type error, which
+// is then reported by 'evaluateExpressionTokens'.
+internal bool runExpressionProgram(Compiler* compiler, AST_Expression* expression, CompilerValue* result)
+{
+	AST_Program* program = expression->program;
+	assert(program->stackSize <= AST_PROGRAM_MAX_STACK_SIZE);
+
+	CompilerValue* stack = compiler->expressionStack;
+	s32 used = 0;
+	AST_Instruction* instruction = program->instructions->data;
+	AST_Instruction* end = instruction + program->instructions->used;
+	for (; instruction < end; ++instruction)
+	{
+		switch (instruction->opcode)
+		{
+			case AST_OPCODE_CONSTANT:
+			{
+				AST_Constant* constant = &program->constants->data[instruction->operand];
+				CompilerValue* value = &stack[used++];
+				if (constant->isString)
+				{
+					value->type = COMPILER_VALUE_TYPE_STRING;
+					value->valueString = constant->valueString;
+				}
+				else
+				{
+					value->type = COMPILER_VALUE_TYPE_DOUBLE;
+					value->valueDouble = constant->valueDouble;
+				}
+			}
+			break;
+
+			case AST_OPCODE_IDENTIFIER:
+			{
+				Token name = expression->tokens->data[instruction->operand].name;
+				CompilerValue value = evaluateIdentifier(compiler, name, expression);
+				if (compiler->hasError)
+				{
+					*result = value;
+					return true;
+				}
+				if (value.type == COMPILER_VALUE_TYPE_BACKEND_IDENTIFIER || value.type == COMPILER_VALUE_TYPE_BACKEND_EXPRESSION)
+				{
+					return false;
+				}
+				stack[used++] = value;
+			}
+			break;
+
+			case AST_OPCODE_ADD:
+			{
+				s32 count = instruction->count;
+				assert(count >= 2 && count <= used);
+				CompilerValue* values = &stack[used - count];
+				if (values[0].type == COMPILER_VALUE_TYPE_STRING)
+				{
+					s32 length = 0;
+					for (s32 i = 0; i < count; ++i)
+					{
+						if (values[i].type != COMPILER_VALUE_TYPE_STRING)
+						{
+							return false;
+						}
+						length += values[i].valueString.length;
+					}
+					char* data = (char*)pushSizeUninitialized(length + 1, compiler->pool);
+					char* at = data;
+					for (s32 i = 0; i < count; ++i)
+					{
+						memcpy(at, values[i].valueString.data, values[i].valueString.length);
+						at += values[i].valueString.length;
+					}
+					values[0].valueString.data = data;
+					values[0].valueString.length = length;
+				}
+				else if (values[0].type == COMPILER_VALUE_TYPE_DOUBLE)
+				{
+					for (s32 i = 1; i < count; ++i)
+					{
+						if (values[i].type != COMPILER_VALUE_TYPE_DOUBLE)
+						{
+							return false;
+						}
+						values[0].valueDouble += values[i].valueDouble;
+					}
+				}
+				else
+				{
+					return false;
+				}
+				used -= count - 1;
+			}
+			break;
+
+			default:
+			{
+				assert(used >= 2);
+				CompilerValue* lval = &stack[used - 2];
+				CompilerValue* rval = &stack[used - 1];
+				if (lval->type == COMPILER_VALUE_TYPE_STRING && rval->type == COMPILER_VALUE_TYPE_STRING
+					&& instruction->opcode == AST_OPCODE_COND_EQUAL)
+				{
+					lval->valueDouble = lval->valueString.cmp(rval->valueString);
+					lval->type = COMPILER_VALUE_TYPE_DOUBLE;
+				}
+				else if (lval->type == COMPILER_VALUE_TYPE_DOUBLE 
+						&& (rval->type == COMPILER_VALUE_TYPE_DOUBLE || rval->type == COMPILER_VALUE_TYPE_STRING)
+						&& instruction->opcode != AST_OPCODE_COND_EQUAL)
+				{
+					*lval = compute(compiler, *lval, *rval, expression->tokens->data[instruction->operand]);
+				}
+				else
+				{
+					return false;
+				}
+				--used;
+			}
+			break;
+		}
+	}
+	assert(used == 1);
+	*result = stack[0];
+	return true;
+}
+
+CompilerValue evaluateExpression(Compiler* compiler, AST_Expression* expression)
+{
+	assert(expression != NULL);
+	if (expression->program != NULL)
+	{
+		CompilerValue result;
+		if (runExpressionProgram(compiler, expression, &result))
+		{
+			return result;
+		}
+	}
+	return evaluateExpressionTokens(compiler, expression);
+}
+
 CompilerParameters* evaluateParameters(Compiler* compiler, AST_Parameters* parameters) {
 	assert(parameters != NULL);
 	CompilerParameters* result = pushStruct(CompilerParameters, compiler->pool);
@@ -524,7 +699,7 @@ void evaluateParametersAndModifyExistingParameters(Compiler* compiler, AST_Param
 	for (s32 i = 0; i < parameters->names->used; ++i)
 	{
 		Token& it = parameters->names->data[i];
-		s32 findIndex = existingParameters->names->find(it);
+		s32 findIndex = findByAtom(existingParameters->names, it.atom);
 		if (findIndex != -1)
 		{
 			// If found property
@@ -586,15 +761,129 @@ void evaluateParametersAndModifyExistingParameters(Compiler* compiler, AST_Param
 	}
 }
 
+// Determine what each identifier in the layout is, is it a component, a tag or a backend
+// identifier/function? This is done once up-front so that the AST is not modified while
+// layouts are being compiled.
+void resolveIdentifiers(Compiler* compiler, AST_Layout* layout)
+{
+	assert(layout != NULL);
+
+	// NOTE: Order doesn't matter here so walk the layouts nodes linearly rather than as a tree.
+	for (s32 nodeIndex = 0; nodeIndex < layout->nodes->used; ++nodeIndex)
+	{
+		AST* ast_top = layout->nodes->data[nodeIndex];
+		// NOTE: Tags and components are resolved again as in watch mode the component they
+		//		 refer to can be added, removed or re-parsed between compiles.
+		if (ast_top->type == AST_IDENTIFIER || ast_top->type == AST_TAG || ast_top->type == AST_COMPONENT)
+		{
+			AST_Identifier* ast = (AST_Identifier*)ast_top;
+			if (ast_top->type == AST_IDENTIFIER && ast->name.isBackend()) 
+			{
+				if (ast->isFunction) 
+				{
+					ast->type = AST_BACKEND_FUNCTION;
+				}
+				else
+				{
+					ast->type = AST_BACKEND_IDENTIFIER;
+				}
+				ast->name.data += 1;
+				ast->name.length -= 1;
+			}
+			else if (ast->name.atom == ATOM_CHILDREN)
+			{
+				// no-op, handled in compileLayout
+			}
+			else
+			{
+				AST_ComponentDefinition* definition = findComponentDefinition(compiler, ast->name);
+				if (compiler->hasError)
+				{
+					return;
+				}
+
+				if (definition == NULL)
+				{
+					// todo(Jake): Check for 'func [name]' when that's parsed/implemented, if it has 'childNodes', then it
+					//			   cannot be a function. 
+					// If no definition, assume HTML tag
+					ast->type = AST_TAG;
+					ast->definition = NULL;
+				}
+				else
+				{
+					ast->type = AST_COMPONENT;
+					ast->definition = definition;
+				}
+			}
+		}
+	}
+}
+
+// Expanding a component gives the same HTML for the same evaluated properties as long as it has its own
+// variable scope, otherwise its layout reads the variables of whatever layout it's used in.
+// Returns an empty key if the expansion can't be shared, ie. a property is a backend expression.
+internal String getComponentExpansionKey(AST_ComponentDefinition* definition, CompilerParameters* properties, TemporaryPool pool)
+{
+	String result = {};
+	bool hasScope = (properties != NULL && properties->values->used > 0)
+					|| (definition->layout->variables != NULL && definition->layout->variables->used > 0);
+	if (!hasScope)
+	{
+		return result;
+	}
+
+	// Key is the definition pointer followed by the type and value of each property, in definition order.
+	s32 length = sizeof(definition);
+	s32 propertyCount = (properties != NULL) ? properties->values->used : 0;
+	for (s32 i = 0; i < propertyCount; ++i)
+	{
+		CompilerValue* value = &properties->values->data[i];
+		switch (value->type)
+		{
+			case COMPILER_VALUE_TYPE_UNDEFINED: length += 1; break;
+			case COMPILER_VALUE_TYPE_STRING: length += 1 + sizeof(s32) + value->valueString.length; break;
+			case COMPILER_VALUE_TYPE_DOUBLE: length += 1 + sizeof(double); break;
+			default:
+				return result;
+		}
+	}
+
+	char* at = (char*)pushSizeUninitialized(length, pool._allocator);
+	result.data = at;
+	result.length = length;
+	memcpy(at, &definition, sizeof(definition));
+	at += sizeof(definition);
+	for (s32 i = 0; i < propertyCount; ++i)
+	{
+		CompilerValue* value = &properties->values->data[i];
+		*at++ = (char)value->type;
+		if (value->type == COMPILER_VALUE_TYPE_STRING)
+		{
+			memcpy(at, &value->valueString.length, sizeof(s32));
+			at += sizeof(s32);
+			memcpy(at, value->valueString.data, value->valueString.length);
+			at += value->valueString.length;
+		}
+		else if (value->type == COMPILER_VALUE_TYPE_DOUBLE)
+		{
+			memcpy(at, &value->valueDouble, sizeof(double));
+			at += sizeof(double);
+		}
+	}
+	assert(at == result.data + result.length);
+	return result;
+}
+
 inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, CompilerParameters* parameters)
 {
 	assert(layout != NULL);
 
 	TemporaryPoolScope tempPool(compiler->poolTransient);
-	Array<AST*> stack(256, tempPool);
-	for (s32 i = layout->childNodes->used - 1; i >= 0; --i)
+	Array<AST_Index> stack(256, tempPool);
+	for (s32 i = layout->childCount - 1; i >= 0; --i)
 	{
-		stack.push(layout->childNodes->data[i]);
+		stack.push(layout->getChildIndex(layout, i));
 	}
 
 	//
@@ -650,7 +939,7 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 					Token& name = parameters->names->data[i];
 					for (s32 j = 0; j < variableStack->names->used; ++j)
 					{
-						if (name.cmp(variableStack->names->data[j]))
+						if (name.atom == variableStack->names->data[j].atom)
 						{
 							variableStack->values->data[j] = parameters->values->data[i];
 							continue;
@@ -695,16 +984,34 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 
 	while (stack.used > 0)
 	{
-		AST* ast_top = stack.top();
-		if (ast_top == NULL)
+		AST_Index ast_top_index = stack.top();
+		if (ast_top_index == AST_INDEX_NONE)
 		{
 			stack.pop();
 			elementTopStack.pop();
 			continue;
 		}
+		AST* ast_top = layout->getNode(ast_top_index);
 		HTML* newElement = NULL;
 
-		if (ast_top->type == AST_TAG)
+		// 'when' keyword, if false then don't output this tag/component but still
+		// output its children.
+		bool skipElement = false;
+		if (ast_top->type == AST_TAG || ast_top->type == AST_COMPONENT)
+		{
+			AST_Identifier* ast = (AST_Identifier*)ast_top;
+			if (ast->expression.tokens != NULL && ast->expression.tokens->used > 0)
+			{
+				CompilerValue value = evaluateExpression(compiler, &ast->expression);
+				skipElement = !value.isTrue();
+			}
+		}
+
+		if (skipElement)
+		{
+			// no-op, children are added to the current parent below
+		}
+		else if (ast_top->type == AST_TAG)
 		{
 			AST_Identifier* ast = (AST_Identifier*)ast_top;
 
@@ -796,9 +1103,9 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 						}
 
 						// Add children and keep this AST element on the stack
-						for (s32 i = ast_top->childNodes->used - 1; i >= 0; --i)
+						for (s32 i = ast_top->childCount - 1; i >= 0; --i)
 						{
-							stack.push(ast_top->childNodes->data[i]);
+							stack.push(layout->getChildIndex(ast_top, i));
 						}
 						continue;
 					}
@@ -818,6 +1125,25 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 			//
 			assert(ast->definition != NULL);
 
+			// Add component to list of used components
+			addComponentUsed(compiler->componentsUsed, ast->definition);
+
+			// Copy in the pre-rendered HTML of static components, unless given parameters or children.
+			ComponentIndexEntry* entry = &compiler->componentIndex[ast->definition->name.atom];
+			if (entry->fragment != NULL && ast->parameters == NULL && ast_top->childCount == 0)
+			{
+				assert(entry->definition == ast->definition);
+				for (s32 i = 0; i < entry->fragment->componentsUsed->used; ++i)
+				{
+					addComponentUsed(compiler->componentsUsed, entry->fragment->componentsUsed->data[i]);
+				}
+				HTML_Static* element = pushHTML(HTML_Static, HTML_STATIC, compiler->pool);
+				element->name = ast->name;
+				element->component = ast->definition;
+				element->fragment = entry->fragment;
+				newElement = element;
+			}
+
 			AST_Parameters* parameters = ast->parameters;
 			if (parameters != NULL && parameters->values != NULL && parameters->values->used > 0)
 			{
@@ -832,7 +1158,7 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 			}
 
 			AST_Layout* layout = ast->definition->layout;
-			if (layout != NULL)
+			if (layout != NULL && newElement == NULL)
 			{
 				CompilerParameters* evaluatedParameters = NULL;
 				if (ast->definition->properties != NULL) 
@@ -855,87 +1181,77 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 					return NULL;
 				}
 
-				newElement = compileLayout(compiler, ast->definition->layout, evaluatedParameters);
-			}
-		}
-		else if (ast_top->type == AST_IDENTIFIER)
-		{
-			//
-			// Determine what this identifier is, is it a component, a function, or what?
-			//
-			AST_Identifier* ast = (AST_Identifier*)ast_top;
-
-			if (ast->name.isBackend()) 
-			{
-				if (ast->isFunction) 
-				{
-					ast->type = AST_BACKEND_FUNCTION;
-				}
-				else
-				{
-					ast->type = AST_BACKEND_IDENTIFIER;
-				}
-				ast->name.data += 1;
-				ast->name.length -= 1;
-				continue; // re-iterate over this 'ast'
-			}
-			else if (ast->name.cmp("children"))
-			{
-				if (component == NULL)
-				{
-					compiler->hasError = true;
-					compileError("Cannot use 'children' keyword in this context. It's reserved for component layouts.");
-					return NULL;
-				}
-
-				HTML_Element* element = pushHTML(HTML_Element, HTML_ELEMENT_VIRTUAL, compiler->pool);
-				element->name = ast->name;
-				element->component = component;
-				newElement = element;
-
-				elementResult->childInsertionElement = element;
-			}
-			else
-			{
-				AST_ComponentDefinition* definition = findComponentDefinition(compiler, ast->name);
-				if (compiler->hasError)
+				// Reuse the expansion from an earlier use with the same properties. Uses with children
+				// can't share it as their children get inserted into the expanded tree.
+				String expansionKey = {};
+				if (compiler->componentExpansions != NULL && ast_top->childCount == 0)
 				{
-					return NULL;
+					expansionKey = getComponentExpansionKey(ast->definition, evaluatedParameters, tempPool);
 				}
-
-				if (definition == NULL)
+				HTML_Expansion* expansion = NULL;
+				if (expansionKey.length > 0)
 				{
-					// todo(Jake): Check for 'func [name]' when that's parsed/implemented, if it has 'childNodes', then it
-					//			   cannot be a function. 
-					// If no definition, assume HTML tag
-					ast->type = AST_TAG;
+					expansion = compiler->componentExpansions->find(expansionKey);
 				}
-				else
+				if (expansion != NULL)
 				{
-					ast->type = AST_COMPONENT;
-					ast->definition = definition;
-					// Add component to list of used components
-					if (compiler->componentsUsed->find(ast->definition) == -1) {
-						compiler->componentsUsed->push(ast->definition);
+					for (s32 i = 0; i < expansion->componentsUsed->used; ++i)
+					{
+						addComponentUsed(compiler->componentsUsed, expansion->componentsUsed->data[i]);
 					}
+					newElement = expansion->html;
 				}
-
-				if (ast->expression.tokens != NULL && ast->expression.tokens->used > 0)
+				else if (expansionKey.length > 0)
 				{
-					CompilerValue value = evaluateExpression(compiler, &ast->expression);
-					if (value.isTrue())
+					// Track the components nested in this one so they can be added on each reuse.
+					Array<AST_ComponentDefinition*>* componentsUsed = compiler->componentsUsed;
+					compiler->componentsUsed = Array<AST_ComponentDefinition*>::create(16, compiler->pool);
+					HTML_Element* html = compileLayout(compiler, ast->definition->layout, evaluatedParameters);
+					Array<AST_ComponentDefinition*>* nestedComponentsUsed = compiler->componentsUsed;
+					compiler->componentsUsed = componentsUsed;
+					for (s32 i = 0; i < nestedComponentsUsed->used; ++i)
 					{
-						continue; // re-iterate over this 'ast'
+						addComponentUsed(compiler->componentsUsed, nestedComponentsUsed->data[i]);
 					}
-					// if false, drop down below, remove this element from the stack but add
-					// its children
+					if (html != NULL && !compiler->hasError)
+					{
+						String key = {};
+						key.length = expansionKey.length;
+						key.data = (char*)pushSizeUninitialized(key.length, compiler->pool);
+						memcpy(key.data, expansionKey.data, key.length);
+						expansion = compiler->componentExpansions->findOrAdd(key);
+						expansion->html = html;
+						expansion->componentsUsed = nestedComponentsUsed;
+					}
+					newElement = html;
 				}
 				else
 				{
-					continue; // re-iterate over this 'ast'
+					newElement = compileLayout(compiler, ast->definition->layout, evaluatedParameters);
 				}
 			}
 		}
+		else if (ast_top->type == AST_IDENTIFIER)
+		{
+			// NOTE: Everything but 'children' is resolved to a tag/component/backend
+			//		 identifier by 'resolveIdentifiers' before compiling.
+			AST_Identifier* ast = (AST_Identifier*)ast_top;
+			assert(ast->name.atom == ATOM_CHILDREN);
+
+			if (component == NULL)
+			{
+				compiler->hasError = true;
+				compileError("Cannot use 'children' keyword in this context. It's reserved for component layouts.");
+				return NULL;
+			}
+
+			HTML_Element* element = pushHTML(HTML_Element, HTML_ELEMENT_VIRTUAL, compiler->pool);
+			element->name = ast->name;
+			element->component = component;
+			newElement = element;
+
+			elementResult->childInsertionElement = element;
+		}
 		else if (ast_top->type == AST_STATEMENT)
 		{
 			AST_Statement* ast = (AST_Statement*)ast_top;
@@ -943,7 +1259,7 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 			assert(stackVariables != NULL);
 			assert(ast->op.type == TOKEN_EQUAL);
 
-			s32 findIndex = stackVariables->names->find(ast->name);
+			s32 findIndex = findByAtom(stackVariables->names, ast->name.atom);
 			assert(findIndex != -1); // can't find variable
 			if (findIndex != -1)
 			{
@@ -984,14 +1300,14 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 		}
 			
 		stack.pop();
-		if (ast_top->childNodes->used > 0)
+		if (ast_top->childCount > 0)
 		{
 			if (newElement != NULL)
 			{
-				// Add NULL which represents end of this block, this is used to detect when the current
+				// Add AST_INDEX_NONE which represents end of this block, this is used to detect when the current
 				// top level element should be popped off the end. This ensures HTML elements are properly
 				// nested.
-				stack.push(NULL);
+				stack.push(AST_INDEX_NONE);
 				if (newElement->type == HTML_ROOT)
 				{
 					// Inserts future elements underneath whatever element the 'children' keyword was found in.
@@ -1016,9 +1332,9 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 			}
 			// Add children in reverse so that they're processed from first to last
 			// (as this loop pops values off the end of the array)
-			for (s32 i = ast_top->childNodes->used - 1; i >= 0; --i)
+			for (s32 i = ast_top->childCount - 1; i >= 0; --i)
 			{
-				stack.push(ast_top->childNodes->data[i]);
+				stack.push(layout->getChildIndex(ast_top, i));
 			}
 		}
 	}
@@ -1032,7 +1348,17 @@ inline HTML_Element* compileLayout(Compiler* compiler, AST_Layout* layout, Compi
 	return elementResult;
 }
 
-inline CSS_Rule* compileStyle(Compiler* compiler, CSS_Rule* styleBlockRule)
+struct CSS_FlattenEntry {
+	CSS_Rule* rule;
+	Array<CSS_SelectorChain*>* parentSelectors; // NULL if not nested in a selector rule
+	CSS_Rule* mediaQuery;
+};
+
+// Flattens the nested rules of a 'style' block into a list of rules, in the order they're written.
+// Each nested selector is a chain back to its parents selector set, so the product of nested comma
+// separated selectors costs one node per combination rather than a copy of every selector in it.
+// @media rules are flattened through, their rules keep the selectors of the rule they're inside.
+internal Array<CSS_FlatRule>* compileStyle(Compiler* compiler, CSS_Rule* styleBlockRule)
 {
 	if (styleBlockRule->properties->used > 0)
 	{
@@ -1041,187 +1367,1028 @@ inline CSS_Rule* compileStyle(Compiler* compiler, CSS_Rule* styleBlockRule)
 		return NULL;
 	}
 
-	// Setup flat array of CSS rules
-	TemporaryPoolScope tempPoolFnScope(compiler->poolTransient);
-	Array<CSS_Rule*>* flatCSSRuleArray = Array<CSS_Rule*>::create(1024, tempPoolFnScope);
-	
-	// Recursively iterate through and add to flat array
+	Array<CSS_FlatRule>* result = Array<CSS_FlatRule>::create(64, compiler->pool);
+
+	TemporaryPoolScope tempPool(compiler->poolTransient);
+	s32 stackSize = (styleBlockRule->childRules->used > 256) ? styleBlockRule->childRules->used : 256;
+	Array<CSS_FlattenEntry>* stack = Array<CSS_FlattenEntry>::create(stackSize, tempPool);
+	for (s32 i = styleBlockRule->childRules->used - 1; i >= 0; --i)
 	{
-		TemporaryPoolScope stackTempPool(compiler->poolTransient);
-		Array<CSS_Rule*>* stack = Array<CSS_Rule*>::create(256, stackTempPool);
-		stack->push(styleBlockRule);
-		while (stack->used > 0)
-		{
-			CSS_Rule* stackTop = stack->pop();
-			flatCSSRuleArray->push(stackTop);
-			for (s32 i = stackTop->childRules->used - 1; i >= 0; --i)
-			{
-				stack->push(stackTop->childRules->data[i]);
-			}
-		}
+		CSS_FlattenEntry entry = {};
+		entry.rule = styleBlockRule->childRules->data[i];
+		stack->push(entry);
 	}
-
-	// NOTE(Jake): Skip item 0 as the first CSS_Rule will never have a parent.
-	for (s32 i = 1; i < flatCSSRuleArray->used; ++i)
+	while (stack->used > 0)
 	{
-		CSS_Rule* rule = flatCSSRuleArray->data[i];
-		assert(rule->parent != NULL);
+		CSS_FlattenEntry entry = stack->pop();
+		CSS_Rule* rule = entry.rule;
 
+		Array<CSS_SelectorChain*>* selectors = entry.parentSelectors;
+		CSS_Rule* mediaQuery = entry.mediaQuery;
 		if (rule->type == CSS_RULE_MEDIAQUERY)
 		{
-			if (rule->parent != styleBlockRule)
+			if (mediaQuery != NULL)
 			{
-				/*
-					Handle @media query underneath CSS rule case
-					---------------------------------------------
-					.test {
-						.banner {
-							@media screen and (max-width: 1140px) {
-								color: #000;
-							}
-						}
-					}
-				*/
-
-
-				CSS_Rule* parent = rule->parent;
-				while (parent->parent != styleBlockRule)
-				{
-					parent = parent->parent;
+				// todo: Combine the queries with 'and', each one is hoisted to the top level.
+				Token* token = &rule->selectorSets->data[0].data[0].token;
+				compileError("Nested @media queries are not supported on Line %d.", token->lineNumber);
+				return NULL;
+			}
+			mediaQuery = rule;
+		}
+		else
+		{
+			assert(rule->type == CSS_RULE_SELECTOR);
+			Array<Array<CSS_Selector>>* selectorSets = rule->selectorSets;
+			s32 parentCount = (entry.parentSelectors != NULL) ? entry.parentSelectors->used : 1;
+			s32 count = parentCount * selectorSets->used;
+			selectors = Array<CSS_SelectorChain*>::create(count, compiler->pool);
+			CSS_SelectorChain* chains = pushArrayStruct(CSS_SelectorChain, count, compiler->pool);
+			for (s32 p = 0; p < parentCount; ++p)
+			{
+				CSS_SelectorChain* parent = (entry.parentSelectors != NULL) ? entry.parentSelectors->data[p] : NULL;
+				for (s32 s = 0; s < selectorSets->used; ++s)
+				{
+					CSS_SelectorChain* chain = &chains[selectors->used];
+					chain->selectors = &selectorSets->data[s];
+					chain->parent = parent;
+					selectors->push(chain);
+				}
+			}
+		}
+
+		if (rule->properties != NULL && rule->properties->used > 0)
+		{
+			if (selectors == NULL)
+			{
+				CSS_Property* prop = &rule->properties->data[0];
+				compileError("No properties should exist outside a selector rule on Line %d.", prop->name.lineNumber);
+				return NULL;
+			}
+			if (result->used == result->size)
+			{
+				result->resize(result->size * 2);
+			}
+			CSS_FlatRule flatRule = {};
+			flatRule.selectors = selectors;
+			flatRule.properties = rule->properties;
+			flatRule.mediaQuery = mediaQuery;
+			result->push(flatRule);
+		}
+
+		// Add children in reverse so that they're processed from first to last
+		stackSize = stack->used + rule->childRules->used;
+		if (stackSize > stack->size)
+		{
+			if (stack->used == 0)
+			{
+				stack = Array<CSS_FlattenEntry>::create(stackSize * 2, tempPool);
+			}
+			else
+			{
+				stack->resize(stackSize * 2);
+			}
+		}
+		for (s32 i = rule->childRules->used - 1; i >= 0; --i)
+		{
+			CSS_FlattenEntry child = {};
+			child.rule = rule->childRules->data[i];
+			child.parentSelectors = selectors;
+			child.mediaQuery = mediaQuery;
+			stack->push(child);
+		}
+	}
+	return result;
+}
+
+// Key is the type and text of each token, with the number of tokens before each selector set.
+internal String getCSSMediaQueryKey(CSS_Rule* mediaQuery, TemporaryPool pool)
+{
+	Array<Array<CSS_Selector>>* selectorSets = mediaQuery->selectorSets;
+	s32 length = 0;
+	for (s32 i = 0; i < selectorSets->used; ++i)
+	{
+		Array<CSS_Selector>* selectors = &selectorSets->data[i];
+		length += sizeof(s32);
+		for (s32 j = 0; j < selectors->used; ++j)
+		{
+			length += 1 + sizeof(s32) + selectors->data[j].token.length;
+		}
+	}
+
+	String result = {};
+	char* at = (char*)pushSizeUninitialized(length, pool._allocator);
+	result.data = at;
+	result.length = length;
+	for (s32 i = 0; i < selectorSets->used; ++i)
+	{
+		Array<CSS_Selector>* selectors = &selectorSets->data[i];
+		memcpy(at, &selectors->used, sizeof(s32));
+		at += sizeof(s32);
+		for (s32 j = 0; j < selectors->used; ++j)
+		{
+			Token* token = &selectors->data[j].token;
+			*at++ = (char)token->type;
+			memcpy(at, &token->length, sizeof(s32));
+			at += sizeof(s32);
+			memcpy(at, token->data, token->length);
+			at += token->length;
+		}
+	}
+	assert(at == result.data + result.length);
+	return result;
+}
+
+// Hoists rules inside @media after every other rule, grouped so each distinct media query is only
+// printed once. Media queries are the same if they're made of the same tokens, each group uses
+// the first @media rule found as its 'mediaQuery'. Rules keep their order within each group.
+// NOTE: Rules in media queries are written to override the rules outside of them, so they're
+//		 moved after them rather than before.
+internal Array<CSS_FlatRule>* groupCSSMediaQueries(Compiler* compiler, Array<CSS_FlatRule>* rules)
+{
+	Array<CSS_FlatRule>* result = Array<CSS_FlatRule>::create(rules->used, compiler->pool);
+	if (rules->used == 0)
+	{
+		return result;
+	}
+
+	// Find the group of each rule, group 0 is rules that aren't in a media query.
+	TemporaryPoolScope tempPool(compiler->poolTransient);
+	HashTable<s32>* groupLookup = HashTable<s32>::create(64, tempPool._allocator);
+	Array<CSS_Rule*>* groupMediaQuery = Array<CSS_Rule*>::create(rules->used + 1, tempPool);
+	Array<s32>* groupStart = Array<s32>::create(rules->used + 1, tempPool);
+	s32* ruleGroup = pushArrayStruct(s32, rules->used, tempPool._allocator);
+	groupMediaQuery->push(NULL);
+	groupStart->push(0);
+	for (s32 i = 0; i < rules->used; ++i)
+	{
+		CSS_Rule* mediaQuery = rules->data[i].mediaQuery;
+		s32 group = 0;
+		if (mediaQuery != NULL)
+		{
+			bool wasAdded = false;
+			s32* groupIndex = groupLookup->findOrAdd(getCSSMediaQueryKey(mediaQuery, tempPool), &wasAdded);
+			if (wasAdded)
+			{
+				*groupIndex = groupMediaQuery->used;
+				groupMediaQuery->push(mediaQuery);
+				groupStart->push(0);
+			}
+			group = *groupIndex;
+		}
+		ruleGroup[i] = group;
+		++groupStart->data[group];
+	}
+
+	// Turn group sizes into where each group starts, then find where each rule goes.
+	s32 start = 0;
+	for (s32 i = 0; i < groupStart->used; ++i)
+	{
+		s32 count = groupStart->data[i];
+		groupStart->data[i] = start;
+		start += count;
+	}
+	s32* order = pushArrayStruct(s32, rules->used, tempPool._allocator);
+	for (s32 i = 0; i < rules->used; ++i)
+	{
+		order[groupStart->data[ruleGroup[i]]++] = i;
+	}
+	for (s32 i = 0; i < rules->used; ++i)
+	{
+		CSS_FlatRule rule = rules->data[order[i]];
+		rule.mediaQuery = groupMediaQuery->data[ruleGroup[order[i]]];
+		result->push(rule);
+	}
+	return result;
+}
+
+// Text that's the same for rules with the same selectors (or the same properties) in the same
+// media query, see 'bundleCSSRules'. 'mediaQueryKey' is from 'getCSSMediaQueryKey', empty if none.
+internal String getCSSBundleKey(Buffer& buffer, CSS_FlatRule* rule, String mediaQueryKey, bool isSelectors, TemporaryPool pool)
+{
+	buffer.clear();
+	if (isSelectors)
+	{
+		printCSSFlatRuleSelectors(buffer, rule, true);
+	}
+	else
+	{
+		printCSSProperties(buffer, rule->properties, true);
+	}
+
+	String result = {};
+	result.length = mediaQueryKey.length + buffer.used;
+	result.data = (char*)pushSizeUninitialized(result.length, pool._allocator);
+	memcpy(result.data, mediaQueryKey.data, mediaQueryKey.length);
+	memcpy(result.data + mediaQueryKey.length, buffer.data, buffer.used);
+	return result;
+}
+
+// At least as long as the rules selectors or properties when minified, see 'getCSSBundleKey'.
+internal s32 getCSSBundleKeyMaxLength(CSS_FlatRule* rule)
+{
+	s32 length = 0;
+	for (s32 i = 0; i < rule->selectors->used; ++i)
+	{
+		for (CSS_SelectorChain* chain = rule->selectors->data[i]; chain != NULL; chain = chain->parent)
+		{
+			for (s32 j = 0; j < chain->selectors->used; ++j)
+			{
+				CSS_Selector* selector = &chain->selectors->data[j];
+				if (selector->type == CSS_SELECTOR_ATTRIBUTE)
+				{
+					// NOTE: Room for the '[=""]' around it
+					length += selector->attribute.name.length + selector->attribute.value.length + 5;
+				}
+				else
+				{
+					length += selector->token.length;
+				}
+				++length; // Space before it
+			}
+			++length; // Space or comma before it
+		}
+	}
+	if (rule->properties != NULL)
+	{
+		for (s32 i = 0; i < rule->properties->used; ++i)
+		{
+			CSS_Property* property = &rule->properties->data[i];
+			length += property->name.length + 2;
+			for (s32 j = 0; j < property->tokens->used; ++j)
+			{
+				CSS_PropertyToken* token = &property->tokens->data[j];
+				length += 1 + token->token.length + 2;
+				s32 argumentCount = (token->arguments != NULL) ? token->arguments->used : 0;
+				for (s32 k = 0; k < argumentCount; ++k)
+				{
+					length += 1 + token->arguments->data[k].length;
+				}
+			}
+		}
+	}
+	return length;
+}
+
+// Shorthands and the properties they set are treated as the same property when bundling, so they
+// share a family. Usually that's the name up to the first '-' (ie. 'margin' for 'margin-top'),
+// ignoring any vendor prefix. 'all' sets every property, see 'canMoveCSSRule'.
+internal String getCSSPropertyFamily(String name)
+{
+	String result = name;
+	if (result.length > 1 && result.data[0] == '-')
+	{
+		if (result.data[1] == '-')
+		{
+			// Custom property, ie. '--main-color'
+			return name;
+		}
+		// Vendor prefix, ie. '-webkit-' in '-webkit-transition'
+		s32 i = 1;
+		while (i < result.length && result.data[i] != '-')
+		{
+			++i;
+		}
+		if (i + 1 < result.length)
+		{
+			result.data += i + 1;
+			result.length -= i + 1;
+		}
+	}
+	for (s32 i = 0; i < result.length; ++i)
+	{
+		if (result.data[i] == '-')
+		{
+			result.length = i;
+			break;
+		}
+	}
+
+	// Shorthands that set properties without their name as a prefix, ie. 'inset' sets 'top'.
+	static const char* families[][2] = {
+		{ "top", "inset" }, { "right", "inset" }, { "bottom", "inset" }, { "left", "inset" },
+		{ "line", "font" }, // 'line-height'
+		{ "columns", "column" }, { "gap", "column" }, { "row", "column" }, // 'gap' sets 'row-gap' and 'column-gap'
+		{ "align", "place" }, { "justify", "place" },
+	};
+	for (s32 i = 0; i < (s32)ArrayCount(families); ++i)
+	{
+		if (result.cmp((char*)families[i][0]))
+		{
+			return String::create(families[i][1]);
+		}
+	}
+	return result;
+}
+
+internal bool isSameCSSProperty(CSS_Property* a, CSS_Property* b)
+{
+	if (!a->name.cmp(b->name) || a->tokens->used != b->tokens->used)
+	{
+		return false;
+	}
+	for (s32 i = 0; i < a->tokens->used; ++i)
+	{
+		CSS_PropertyToken* tokenA = &a->tokens->data[i];
+		CSS_PropertyToken* tokenB = &b->tokens->data[i];
+		if (!tokenA->token.cmp(tokenB->token))
+		{
+			return false;
+		}
+		s32 argumentCount = (tokenA->arguments != NULL) ? tokenA->arguments->used : 0;
+		if (argumentCount != ((tokenB->arguments != NULL) ? tokenB->arguments->used : 0))
+		{
+			return false;
+		}
+		for (s32 j = 0; j < argumentCount; ++j)
+		{
+			if (!tokenA->arguments->data[j].cmp(tokenB->arguments->data[j]))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// A selector chain can only match if every tag, class and id in it was printed, see 'addHTMLNames'.
+// Anything inside parentheses (ie. `:not(.active)`) and pseudo-classes are ignored.
+internal bool isCSSSelectorChainUsed(HashTable<bool>* names, CSS_SelectorChain* chain)
+{
+	bool hasAnyTag = (names->find(String::create("*")) != NULL);
+	bool hasAnyClass = hasAnyTag || (names->find(String::create(".")) != NULL);
+	bool hasAnyId = hasAnyTag || (names->find(String::create("#")) != NULL);
+	for (; chain != NULL; chain = chain->parent)
+	{
+		s32 parenDepth = 0;
+		for (s32 i = 0; i < chain->selectors->used; ++i)
+		{
+			CSS_Selector* selector = &chain->selectors->data[i];
+			switch (selector->type)
+			{
+				case CSS_SELECTOR_PAREN_OPEN: { ++parenDepth; } break;
+				case CSS_SELECTOR_PAREN_CLOSE: { --parenDepth; } break;
+				case CSS_SELECTOR_MODIFIER:
+				{
+					// Skip the name of the pseudo-class or element (ie. `hover` in `a:hover`)
+					if (i + 1 < chain->selectors->used && chain->selectors->data[i + 1].type == CSS_SELECTOR_TAG)
+					{
+						++i;
+					}
+				} break;
+				case CSS_SELECTOR_TAG:
+				case CSS_SELECTOR_CLASS:
+				case CSS_SELECTOR_ID:
+				{
+					if (parenDepth > 0 || names->find(selector->token) != NULL)
+					{
+						continue;
+					}
+					if ((selector->type == CSS_SELECTOR_TAG && hasAnyTag)
+						|| (selector->type == CSS_SELECTOR_CLASS && hasAnyClass)
+						|| (selector->type == CSS_SELECTOR_ID && hasAnyId))
+					{
+						continue;
+					}
+					return false;
+				} break;
+
+				default:
+					// ie. `*`, `>` and `[type="text"]`
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+// Removes selectors that can't match any element printed by a layout and rules left without any.
+internal Array<CSS_FlatRule>* removeUnusedCSSRules(Compiler* compiler, Array<CSS_FlatRule>* rules, HashTable<bool>* names)
+{
+	Array<CSS_FlatRule>* result = Array<CSS_FlatRule>::create(rules->used + 1, compiler->pool);
+	for (s32 i = 0; i < rules->used; ++i)
+	{
+		CSS_FlatRule rule = rules->data[i];
+		s32 usedCount = 0;
+		for (s32 j = 0; j < rule.selectors->used; ++j)
+		{
+			usedCount += isCSSSelectorChainUsed(names, rule.selectors->data[j]);
+		}
+		if (usedCount == 0)
+		{
+			continue;
+		}
+		if (usedCount != rule.selectors->used)
+		{
+			// NOTE: A new array as the selectors may be shared with other rules.
+			Array<CSS_SelectorChain*>* selectors = Array<CSS_SelectorChain*>::create(usedCount, compiler->pool);
+			for (s32 j = 0; j < rule.selectors->used; ++j)
+			{
+				if (isCSSSelectorChainUsed(names, rule.selectors->data[j]))
+				{
+					selectors->push(rule.selectors->data[j]);
+				}
+			}
+			rule.selectors = selectors;
+		}
+		result->push(rule);
+	}
+	return result;
+}
+
+// Moving 'rule' up to the rule at 'index' can only change the result if a rule after that one
+// sets any of the same properties (or their shorthands/longhands, see 'getCSSPropertyFamily').
+// 'lastSetAt' is keyed by family, 'lastSetAny' is the last rule that set anything.
+internal bool canMoveCSSRule(HashTable<s32>* lastSetAt, s32 lastSetAny, CSS_FlatRule* rule, s32 index)
+{
+	s32* lastAll = lastSetAt->find(String::create("all"));
+	if (lastAll != NULL && *lastAll > index)
+	{
+		return false;
+	}
+	for (s32 i = 0; i < rule->properties->used; ++i)
+	{
+		String family = getCSSPropertyFamily(rule->properties->data[i].name);
+		if (family.cmp("all") && lastSetAny > index)
+		{
+			return false;
+		}
+		s32* last = lastSetAt->find(family);
+		if (last != NULL && *last > index)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Merges rules from every components styles so each selector and each block of properties is only
+// printed once. 'rules' must already be grouped by media query, see 'groupCSSMediaQueries'.
+//	- Rules with the same selectors have their properties added to the first rule.
+//	- Rules with the same properties have their selectors added to the first rule.
+// NOTE: Merging moves a rule up to the first one, so it's only done if no rule between them sets
+//		 any of the same properties or their shorthands/longhands, otherwise which value wins could change.
+internal Array<CSS_FlatRule>* bundleCSSRules(Compiler* compiler, Array<CSS_FlatRule>* rules)
+{
+	Array<CSS_FlatRule>* result = Array<CSS_FlatRule>::create(rules->used, compiler->pool);
+	if (rules->used == 0)
+	{
+		return result;
+	}
+
+	TemporaryPoolScope tempPool(compiler->poolTransient);
+	// NOTE: A rule can end up with the selectors or properties of every rule merged into it.
+	s32 keyBufferSize = 1;
+	for (s32 i = 0; i < rules->used; ++i)
+	{
+		keyBufferSize += getCSSBundleKeyMaxLength(&rules->data[i]);
+	}
+	Buffer keyBuffer(keyBufferSize, tempPool);
+	// NOTE: Lookups go stale when a rule is merged into, so the key is checked against the rules current one.
+	HashTable<s32>* selectorLookup = HashTable<s32>::create(rules->used * 2, tempPool._allocator);
+	HashTable<s32>* propertyLookup = HashTable<s32>::create(rules->used * 2, tempPool._allocator);
+	HashTable<s32>* lastSetAt = HashTable<s32>::create(256, tempPool._allocator); // Property family to the last rule in 'result' setting it
+	s32 lastSetAny = -1;
+	String* selectorKeys = pushArrayStruct(String, rules->used, tempPool._allocator);
+	String* propertyKeys = pushArrayStruct(String, rules->used, tempPool._allocator);
+	CSS_Rule* mediaQuery = NULL;
+	String mediaQueryKey = {};
+	for (s32 i = 0; i < rules->used; ++i)
+	{
+		CSS_FlatRule rule = rules->data[i];
+		if (rule.mediaQuery != mediaQuery)
+		{
+			// NOTE: Rules are grouped by media query, so this is once per group.
+			mediaQuery = rule.mediaQuery;
+			mediaQueryKey.length = 0;
+			if (mediaQuery != NULL)
+			{
+				mediaQueryKey = getCSSMediaQueryKey(mediaQuery, tempPool);
+			}
+		}
+		String selectorKey = getCSSBundleKey(keyBuffer, &rule, mediaQueryKey, true, tempPool);
+		String propertyKey = getCSSBundleKey(keyBuffer, &rule, mediaQueryKey, false, tempPool);
+
+		s32 index = -1;
+		s32* sameSelectors = selectorLookup->find(selectorKey);
+		s32* sameProperties = propertyLookup->find(propertyKey);
+		if (sameSelectors != NULL 
+			&& selectorKeys[*sameSelectors].cmp(selectorKey) 
+			&& canMoveCSSRule(lastSetAt, lastSetAny, &rule, *sameSelectors))
+		{
+			// Add properties, dropping any the first rule has that are set again with the same value
+			index = *sameSelectors;
+			CSS_FlatRule* first = &result->data[index];
+			Array<CSS_Property>* properties = Array<CSS_Property>::create(first->properties->used + rule.properties->used, compiler->pool);
+			for (s32 p = 0; p < first->properties->used; ++p)
+			{
+				CSS_Property* property = &first->properties->data[p];
+				bool isSetAgain = false;
+				for (s32 q = 0; q < rule.properties->used && !isSetAgain; ++q)
+				{
+					isSetAgain = isSameCSSProperty(property, &rule.properties->data[q]);
+				}
+				if (!isSetAgain)
+				{
+					properties->push(*property);
+				}
+			}
+			for (s32 p = 0; p < rule.properties->used; ++p)
+			{
+				properties->push(rule.properties->data[p]);
+			}
+			first->properties = properties;
+			propertyKeys[index] = getCSSBundleKey(keyBuffer, first, mediaQueryKey, false, tempPool);
+			*propertyLookup->findOrAdd(propertyKeys[index]) = index;
+		}
+		else if (sameProperties != NULL 
+				&& propertyKeys[*sameProperties].cmp(propertyKey) 
+				&& canMoveCSSRule(lastSetAt, lastSetAny, &rule, *sameProperties))
+		{
+			// Add selectors the first rule doesn't have yet
+			index = *sameProperties;
+			CSS_FlatRule* first = &result->data[index];
+			HashTable<bool>* firstSelectors = HashTable<bool>::create(first->selectors->used * 2, tempPool._allocator);
+			for (s32 c = 0; c < first->selectors->used; ++c)
+			{
+				keyBuffer.clear();
+				printCSSSelectorChain(keyBuffer, first->selectors->data[c]);
+				String key = {};
+				key.length = keyBuffer.used;
+				key.data = (char*)pushSizeUninitialized(keyBuffer.used, tempPool._allocator);
+				memcpy(key.data, keyBuffer.data, keyBuffer.used);
+				*firstSelectors->findOrAdd(key) = true;
+			}
+			Array<CSS_SelectorChain*>* selectors = Array<CSS_SelectorChain*>::create(first->selectors->used + rule.selectors->used, compiler->pool);
+			for (s32 c = 0; c < first->selectors->used; ++c)
+			{
+				selectors->push(first->selectors->data[c]);
+			}
+			for (s32 c = 0; c < rule.selectors->used; ++c)
+			{
+				keyBuffer.clear();
+				printCSSSelectorChain(keyBuffer, rule.selectors->data[c]);
+				String key = {};
+				key.data = keyBuffer.data;
+				key.length = keyBuffer.used;
+				if (firstSelectors->find(key) == NULL)
+				{
+					selectors->push(rule.selectors->data[c]);
+				}
+			}
+			first->selectors = selectors;
+			selectorKeys[index] = getCSSBundleKey(keyBuffer, first, mediaQueryKey, true, tempPool);
+			*selectorLookup->findOrAdd(selectorKeys[index]) = index;
+		}
+		else
+		{
+			index = result->used;
+			result->push(rule);
+			selectorKeys[index] = selectorKey;
+			propertyKeys[index] = propertyKey;
+			*selectorLookup->findOrAdd(selectorKey) = index;
+			*propertyLookup->findOrAdd(propertyKey) = index;
+		}
+
+		for (s32 p = 0; p < rule.properties->used; ++p)
+		{
+			*lastSetAt->findOrAdd(getCSSPropertyFamily(rule.properties->data[p].name)) = index;
+		}
+		if (rule.properties->used > 0 && index > lastSetAny)
+		{
+			lastSetAny = index;
+		}
+	}
+	return result;
+}
+
+// The stylesheet with the styles of every component used, see 'bundleCSSRules'.
+inline String getStyleOutputPath(Compiler* compiler, AllocatorPool* pool)
+{
+	TemporaryPoolScope tempPoolScope(compiler->poolTransient);
+	StringBuilder builder(2, tempPoolScope);
+	builder.add(compiler->outputDirectory);
+	builder.add("fel.css");
+	return builder.toString(pool);
+}
+
+inline String getLayoutOutputPath(Compiler* compiler, AST_File* ast_file, AllocatorPool* pool)
+{
+	TemporaryPoolScope tempPoolScope(compiler->poolTransient);
+
+	// Trim the target path from pathname
+	String partialPath = ast_file->pathname.substring(compiler->targetDirectory.length);
+	if (partialPath.data[0] == '\\' || partialPath.data[0] == '/')
+	{
+		++partialPath.data;
+		--partialPath.length;
+	}
+	partialPath.length -= 4; // remove '.fel'
+
+	//
+	StringBuilder builder(10, tempPoolScope);
+	builder.add(compiler->outputDirectory);
+	builder.add(partialPath);
+	builder.add(".php");
+	return builder.toString(pool);
+}
+
+//
+// Static components
+//
+inline bool isLiteralExpression(AST_Expression* expression)
+{
+	for (s32 i = 0; i < expression->tokens->used; ++i)
+	{
+		Token* token = &expression->tokens->data[i].name;
+		if (token->type != TOKEN_STRING && token->type != TOKEN_NUMBER && !token->isOperator())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool isLiteralParameters(AST_Parameters* parameters)
+{
+	if (parameters != NULL && parameters->values != NULL)
+	{
+		for (s32 i = 0; i < parameters->values->used; ++i)
+		{
+			if (!isLiteralExpression(parameters->values->data[i]))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// A component is static if its layout prints the same HTML everywhere it's used. That is, it has no
+// variables, 'when'/'if'/'while' conditions, backend identifiers or non-literal parameters, and every
+// component it uses is static too.
+internal bool isStaticComponent(Compiler* compiler, AST_ComponentDefinition* definition)
+{
+	ComponentIndexEntry* entry = &compiler->componentIndex[definition->name.atom];
+	if (entry->definition != definition || entry->definitions != NULL)
+	{
+		// Multiple definitions, this is reported as an error when used
+		return false;
+	}
+	if (entry->isStaticChecked)
+	{
+		return entry->isStatic;
+	}
+	// NOTE: Marked as checked first so components that use themselves aren't static.
+	entry->isStaticChecked = true;
+
+	AST_Layout* layout = definition->layout;
+	if (layout == NULL || (layout->variables != NULL && layout->variables->used > 0))
+	{
+		return false;
+	}
+	for (s32 i = 0; i < layout->nodes->used; ++i)
+	{
+		AST* ast_top = layout->nodes->data[i];
+		switch (ast_top->type)
+		{
+			case AST_TAG:
+			case AST_COMPONENT:
+			{
+				AST_Identifier* ast = (AST_Identifier*)ast_top;
+				if ((ast->expression.tokens != NULL && ast->expression.tokens->used > 0)
+					|| !isLiteralParameters(ast->parameters))
+				{
+					return false;
 				}
-				
-				//rule->parent = styleBlockRule;
-				//parent->parent = rule;
-
+				if (ast_top->type == AST_COMPONENT && !isStaticComponent(compiler, ast->definition))
+				{
+					return false;
+				}
+			}
+			break;
 
-				/*CSS_Rule* newRule = pushStruct(CSS_Rule, compiler->pool);
-				*newRule = *rule->parent;
-				newRule->properties = rule->properties;
-				newRule->parent = rule; // Move CSS rule to be underneath this @media query
-				flatCSSRuleArray->push(newRule);*/
+			case AST_IDENTIFIER:
+			{
+				// Only 'children' is left unresolved
+				AST_Identifier* ast = (AST_Identifier*)ast_top;
+				if (ast->name.atom != ATOM_CHILDREN)
+				{
+					return false;
+				}
 			}
-			continue;
+			break;
+
+			default:
+				return false;
 		}
+	}
+	entry->isStatic = true;
+	return true;
+}
 
-		// Go up parent tree
-		TemporaryPoolScope tempPool(compiler->poolTransient);
-		Array<CSS_Rule*>* treeStack = Array<CSS_Rule*>::create(512, tempPool);
-		Array<s32>* treeIndexStack = Array<s32>::create(512, tempPool);
+// Print each static component once, using the component then copies this in rather than compiling
+// and printing its layout again.
+// NOTE: Must run before compiling layouts across threads, as fragments are shared by every thread.
+internal void buildStaticFragments(Compiler* compiler)
+{
+	for (s32 i = 0; i < compiler->componentIndexCount; ++i)
+	{
+		ComponentIndexEntry* entry = &compiler->componentIndex[i];
+		if (entry->definition == NULL || !isStaticComponent(compiler, entry->definition))
+		{
+			continue;
+		}
 
-		CSS_Rule* parent = rule;
-		CSS_Rule* newParent = styleBlockRule; // default to expanding to top 'style' block
-		while (parent != NULL && parent->parent != NULL)
+		Array<AST_ComponentDefinition*>* componentsUsed = compiler->componentsUsed;
+		compiler->componentsUsed = Array<AST_ComponentDefinition*>::create(16, compiler->pool);
+		compiler->componentsUsed->push(entry->definition);
+		HTML_Element* html = compileLayout(compiler, entry->definition->layout);
+		HTML_Fragment* fragment = NULL;
+		if (html != NULL && !compiler->hasError)
 		{
-			if (parent->type == CSS_RULE_MEDIAQUERY) {
-				// Switch to expanding inside media query
-				newParent = parent;
-				break;
-			}
-			treeStack->push(parent);
-			treeIndexStack->push(0);
-			parent = parent->parent;
+			TemporaryPoolScope tempPoolScope(compiler->poolTransient);
+			Buffer buffer((s32)Megabytes(1), tempPoolScope);
+			buffer.newlines = Array<s32>::create(64, tempPoolScope._allocator);
+			printHTML(buffer, html);
+
+			fragment = pushStruct(HTML_Fragment, compiler->pool);
+			fragment->html.length = buffer.used;
+			fragment->html.data = (char*)pushSizeUninitialized(buffer.used, compiler->pool);
+			memcpy(fragment->html.data, buffer.data, buffer.used);
+			fragment->newlines = buffer.newlines->createCopyExactSize(compiler->pool);
+			fragment->componentsUsed = compiler->componentsUsed;
+			fragment->tree = html;
+		}
+		compiler->componentsUsed = componentsUsed;
+		if (compiler->hasError)
+		{
+			return;
 		}
+		entry->fragment = fragment;
+	}
+}
 
-		if (treeStack->used > 1 && rule->properties != NULL && rule->properties->used > 0)
+// Creates every directory leading up to 'filepath' that doesn't exist yet.
+internal void createParentDirectories(String filepath)
+{
+	for (s32 i = 1; i < filepath.length; ++i)
+	{
+		if (filepath.data[i] == '/' || filepath.data[i] == '\\')
 		{
-			TemporaryPoolScope tempSelectorSetsPool(compiler->poolTransient);
-			Array<Array<CSS_Selector>>* newSelectorSets = Array<Array<CSS_Selector>>::create(255, tempSelectorSetsPool);
+			String directory = filepath;
+			directory.length = i;
+			Directory::create(directory);
+		}
+	}
+}
+
+// Adds 'prefix' followed by 'name' unless it's already there, ie. '.' and 'banner' adds `.banner`.
+internal void addHTMLName(HashTable<bool>* names, char prefix, String name, AllocatorPool* pool)
+{
+	char keyBuffer[256];
+	String key = {};
+	key.length = name.length + 1;
+	key.data = (key.length <= (s32)sizeof(keyBuffer)) ? keyBuffer : (char*)pushSizeUninitialized(key.length, pool);
+	key.data[0] = prefix;
+	memcpy(key.data + 1, name.data, name.length);
+	if (names->find(key) != NULL)
+	{
+		return;
+	}
+	if (key.data == keyBuffer)
+	{
+		key.data = (char*)pushSizeUninitialized(key.length, pool);
+		memcpy(key.data, keyBuffer, key.length);
+	}
+	*names->findOrAdd(key) = true;
+}
 
-			s32 ridiculousIterationCounter = 0;
-			for (;;)
+// Adds the tag, classes and id of every element in 'html' to 'names', written as they would be in
+// a CSS selector, ie. `div`, `.banner` and `#main`. Anything only known once the backend runs is
+// added as a wildcard, `.` or `#` for a class or id set from a backend value and `*` for a backend
+// function, as it could print any element.
+// NOTE: Backend identifiers are printed with 'echo' and treated as text.
+internal void addHTMLNames(Compiler* compiler, HashTable<bool>* names, HTML* html)
+{
+	AllocatorPool* pool = compiler->pool;
+	TemporaryPoolScope tempPool(compiler->poolTransient);
+	Array<HTML*>* stack = Array<HTML*>::create(256, tempPool);
+	stack->push(html);
+	while (stack->used > 0)
+	{
+		HTML* top = stack->pop();
+		if (top->type == HTML_STATIC)
+		{
+			HTML_Static* ast = (HTML_Static*)top;
+			stack->push(ast->fragment->tree);
+			continue;
+		}
+		if (top->type == HTML_BACKEND_FUNCTION && names->find(String::create("*")) == NULL)
+		{
+			*names->findOrAdd(String::create("*")) = true;
+		}
+		if (top->type == HTML_ELEMENT)
+		{
+			HTML_Element* element = (HTML_Element*)top;
+			if (names->find(element->name) == NULL)
 			{
+				*names->findOrAdd(element->name) = true;
+			}
+			CompilerParameters* parameters = element->parameters;
+			for (s32 i = 0; parameters != NULL && parameters->names != NULL && i < parameters->names->used; ++i)
+			{
+				Token* name = &parameters->names->data[i];
+				char prefix = 0;
+				if (name->cmp("class"))
+				{
+					prefix = '.';
+				}
+				else if (name->cmp("id"))
+				{
+					prefix = '#';
+				}
+				else
+				{
+					continue;
+				}
+
+				CompilerValue* value = &parameters->values->data[i];
+				if (value->type != COMPILER_VALUE_TYPE_STRING)
 				{
-					TemporaryPoolScope tempSelectorsPool(compiler->poolTransient);
-					Array<CSS_Selector>* newSelectors = Array<CSS_Selector>::create(512, tempSelectorsPool);
-					for (s32 i = treeStack->used - 1; i >= 0; --i)
+					String wildcard = {};
+					wildcard.data = (prefix == '.') ? (char*)"." : (char*)"#";
+					wildcard.length = 1;
+					if (names->find(wildcard) == NULL)
 					{
-						CSS_Rule* rule = treeStack->data[i];
-						s32 selectorSetIndex = treeIndexStack->data[i];
-						Array<CSS_Selector>* selectors = &rule->selectorSets->data[selectorSetIndex];
-						for (s32 i = 0; i < selectors->used; ++i)
-						{
-							newSelectors->push(selectors->data[i]);
-						}
+						*names->findOrAdd(wildcard) = true;
 					}
-
-					newSelectors = newSelectors->createCopyShrinkToFit(compiler->pool);
-					newSelectorSets->push(*newSelectors);
+					continue;
 				}
 
-				// Increment index, if index becomes bigger then array, bump up the index
-				// of the next item in the tree.
-				// -- parentIndexStack->data[0] == 1
-				// -- parentIndexStack->data[1] == 0
-				// -- parentIndexStack->data[2] == 0
-				treeIndexStack->data[0] += 1;
-				for (s32 i = 0; i < treeStack->used - 1; ++i)
+				// Each class is separated by whitespace
+				String text = value->valueString;
+				s32 start = 0;
+				for (s32 c = 0; c <= text.length; ++c)
 				{
-					CSS_Rule* rule = treeStack->data[i];
-					if (treeIndexStack->data[i] >= rule->selectorSets->used)
+					if (c == text.length || text.data[c] == ' ' || text.data[c] == '\t' || text.data[c] == '\n' || text.data[c] == '\r')
 					{
-						treeIndexStack->data[i+1] += 1;
-						treeIndexStack->data[i] = 0;
+						if (c > start)
+						{
+							String word = {};
+							word.data = text.data + start;
+							word.length = c - start;
+							addHTMLName(names, prefix, word, pool);
+						}
+						start = c + 1;
 					}
 				}
-
-				if (treeIndexStack->data[treeStack->used - 1] >= treeStack->data[treeStack->used - 1]->selectorSets->used)
+			}
+		}
+		if (top->canHaveChildren())
+		{
+			HTML_Block* block = (HTML_Block*)top;
+			if (block->childNodes != NULL)
+			{
+				if (stack->used + block->childNodes->used > stack->size)
 				{
-					break;
+					stack->resize((stack->used + block->childNodes->used) * 2);
+				}
+				for (s32 i = 0; i < block->childNodes->used; ++i)
+				{
+					stack->push(block->childNodes->data[i]);
 				}
-
-				++ridiculousIterationCounter;
-				assert(ridiculousIterationCounter <= 1000000);
 			}
-			rule->selectorSets = newSelectorSets->createCopyShrinkToFit(compiler->pool);
-			rule->parent = newParent;
-
-			// Debug
-			/*CSS_Rule tempRule = {};
-			tempRule.type = CSS_RULE_SELECTOR;
-			tempRule.selectorSets = newSelectorSets;
-			printCSSRule(&tempRule, compiler->poolTransient);*/
 		}
 	}
+}
 
-	// Put into hierarchy
-	// NOTE(Jake): Skip item 0 as the first CSS_Rule will never have a parent.
-	for (s32 i = 1; i < flatCSSRuleArray->used; ++i)
+//
+// Parallel layout compilation
+//
+struct LayoutJob {
+	AST_File* file;
+	AST_Layout* layout;
+	s32 layoutIndex;
+	bool isUpToDate; // Skipped, nothing it depends on has changed since the last run
+	bool hasError;
+	bool hasWriteError; // Couldn't write to 'outputPath', already reported
+	bool hasOutput;
+	String output; // printed HTML
+	String outputPath;
+	Array<AST_ComponentDefinition*>* componentsUsed;
+	HashTable<bool>* names; // Tags, classes and ids printed, see 'addHTMLNames'
+};
+
+struct LayoutWorkQueue {
+	LayoutJob* jobs;
+	s32 jobCount;
+	volatile s32 nextIndex;
+};
+
+struct LayoutWorker {
+	LayoutWorkQueue* queue;
+	// NOTE: Copy of the compiler with its own pools/variable stack, 'astFiles' is shared 
+	//		 and must not be modified once compiling has started.
+	Compiler compiler;
+};
+
+internal void compileLayoutWorkerProc(void* data)
+{
+	LayoutWorker* worker = (LayoutWorker*)data;
+	LayoutWorkQueue* queue = worker->queue;
+	Compiler* compiler = &worker->compiler;
+	for (;;)
 	{
-		CSS_Rule* rule = flatCSSRuleArray->data[i];
-		assert(rule->parent != NULL);
-		rule->childRules->used = 0;
-		if (rule->properties != NULL && rule->properties->used > 0)
+		s32 index = Thread::atomicIncrement(&queue->nextIndex) - 1;
+		if (index >= queue->jobCount)
+		{
+			break;
+		}
+		LayoutJob* job = &queue->jobs[index];
+		if (job->isUpToDate)
+		{
+			continue;
+		}
+
+		// NOTE: When watching, compile errors jump back here so the other layouts still compile and
+		//		 'compile' can report it failed. Whatever the layout left in the arenas is freed with the worker.
+		jmp_buf errorJump;
+		if (compiler->errorJump != NULL)
 		{
-			if (rule->parent->type == CSS_RULE_MEDIAQUERY)
+			compiler->errorJump = &errorJump;
+			if (setjmp(errorJump) != 0)
 			{
-				TemporaryPoolScope tempPoolScope(compiler->poolTransient);
-				Buffer buffer((s32)Kilobytes(1), tempPoolScope);
-				printCSSRuleOpen(buffer, rule->parent);
-				printCSSRule(buffer, rule);
-				printCSSRuleClose(buffer);
-				buffer.print();
+				job->hasError = true;
+				continue;
 			}
-			else if (rule->parent->type != CSS_RULE_MEDIAQUERY) 
+		}
+
+		// NOTE: Track used components per-layout so they can be merged in the
+		//		 same order as a serial compile.
+		compiler->hasError = false;
+		compiler->componentsUsed = Array<AST_ComponentDefinition*>::create(256, compiler->pool);
+		HTML_Element* html = compileLayout(compiler, job->layout);
+		job->componentsUsed = compiler->componentsUsed;
+		job->hasError = compiler->hasError;
+		if (compiler->hasError || html == NULL)
+		{
+			continue;
+		}
+		job->names = HashTable<bool>::create(64, compiler->pool);
+		addHTMLNames(compiler, job->names, html);
+
+		TemporaryPoolScope tempPoolScope(compiler->poolTransient);
+		if (compiler->isWritingOutput)
+		{
+			// Stream straight to the file as it's printed
+			createParentDirectories(job->outputPath);
+			File::Stream stream = File::openStream(job->outputPath);
+			if (stream.platformHandle == NULL)
 			{
-				if (rule->type != CSS_RULE_MEDIAQUERY)
-				{
-					printCSSRule(rule, compiler->poolTransient);
-				}
+				print("Failed to write: %s\n", &job->outputPath);
+				job->hasWriteError = true;
+				continue;
 			}
-			else
+			Buffer buffer((s32)Kilobytes(64), tempPoolScope, &stream);
+			printHTML(buffer, html);
+			buffer.flush();
+			if (!File::closeStream(&stream))
 			{
-				assert(false);
+				print("Failed to write: %s\n", &job->outputPath);
+				job->hasWriteError = true;
+				continue;
 			}
+			job->hasOutput = true;
+			continue;
 		}
+
+		Buffer buffer((s32)Megabytes(4), tempPoolScope);
+		printHTML(buffer, html);
+
+		job->output.length = buffer.used;
+		job->output.data = (char*)pushSizeUninitialized(buffer.used, compiler->pool);
+		memcpy(job->output.data, buffer.data, buffer.used);
+		job->hasOutput = true;
 	}
+}
 
-	assert(false);
-	return styleBlockRule;
+// Worker arenas only hold each layouts output and used components, free them once merged.
+internal void freeLayoutWorkers(LayoutWorker* workers, s32 workerCount)
+{
+	for (s32 i = 0; i < workerCount; ++i)
+	{
+		workers[i].compiler.pool->free();
+	}
 }
 
 void compile(Compiler* compiler)
 {
-	// Compile HTML
+	buildComponentIndex(compiler);
+
+	// Resolve identifiers in all layouts, this must happen before compiling as
+	// compiling happens across multiple threads.
+	s32 layoutCount = 0;
 	for (s32 i = 0; i < compiler->astFiles->used; ++i)
 	{
 		AST_File* ast_file = &compiler->astFiles->data[i];
@@ -1229,81 +2396,369 @@ void compile(Compiler* compiler)
 		{
 			for (s32 j = 0; j < ast_file->layouts->used; ++j)
 			{
-				AST_Layout* layout = &ast_file->layouts->data[j];
-				HTML_Element* html = compileLayout(compiler, layout);
-				if (compiler->hasError)
+				resolveIdentifiers(compiler, &ast_file->layouts->data[j]);
+				++layoutCount;
+			}
+		}
+		if (ast_file->components != NULL)
+		{
+			for (s32 j = 0; j < ast_file->components->used; ++j)
+			{
+				AST_ComponentDefinition* definition = &ast_file->components->data[j];
+				if (definition->layout != NULL)
 				{
-					assert(false);
-					return;
+					resolveIdentifiers(compiler, definition->layout);
 				}
-				if (html != NULL)
-				{
-					TemporaryPoolScope tempPoolScope(compiler->poolTransient);
-					Buffer buffer((s32)Megabytes(4), tempPoolScope);
-					printHTML(buffer, html);
+			}
+		}
+		if (compiler->hasError)
+		{
+			assert(false);
+			return;
+		}
+	}
 
-					// Trim the target path from pathname
-					String partialPath = ast_file->pathname.substring(compiler->targetDirectory.length);
-					if (partialPath.data[0] == '\\' || partialPath.data[0] == '/')
-					{
-						++partialPath.data;
-						--partialPath.length;
-					}
-					partialPath.length -= 4; // remove '.fel'
+	buildStaticFragments(compiler);
+	if (compiler->hasError)
+	{
+		assert(false);
+		return;
+	}
+
+	// Load the dependency graph from the last run so only outputs with changed inputs are rebuilt.
+	DependencyGraph* previousGraph = NULL;
+	DependencyGraph* graph = NULL;
+	HashTable<u64>* contentHashes = NULL;
+	char graphPathBuffer[1024];
+	String graphPath = {};
+	if (compiler->cacheDirectory.length > 0 || compiler->isWatching)
+	{
+		u64 componentsHash = 0;
+		contentHashes = HashTable<u64>::create(compiler->astFiles->used * 2, compiler->pool);
+		for (s32 i = 0; i < compiler->astFiles->used; ++i)
+		{
+			AST_File* ast_file = &compiler->astFiles->data[i];
+			*contentHashes->findOrAdd(ast_file->pathname) = ast_file->contentHash;
+			if (ast_file->components != NULL)
+			{
+				for (s32 j = 0; j < ast_file->components->used; ++j)
+				{
+					// NOTE: Combined in order, as with duplicate names the order decides which definition is used.
+					componentsHash = (componentsHash * 1099511628211ull) ^ hashString64(ast_file->components->data[j].name);
+				}
+			}
+		}
 
-					//
-					StringBuilder builder(10, tempPoolScope);
-					builder.add(compiler->outputDirectory);
-					builder.add(partialPath);
-					builder.add(".php");
-					String outputPath = builder.toString(compiler->pool); // todo(Jake): Decide to make transient or keep
+		previousGraph = compiler->dependencies;
+		if (compiler->cacheDirectory.length > 0)
+		{
+			s32 length = snprintf(graphPathBuffer, sizeof(graphPathBuffer), "%.*s/dependencies.txt", compiler->cacheDirectory.length, compiler->cacheDirectory.data);
+			if (length < 0 || length >= (s32)sizeof(graphPathBuffer))
+			{
+				print("Cache directory path is too long, dependencies won't be saved.\n");
+			}
+			else
+			{
+				graphPath.length = length;
+				graphPath.data = graphPathBuffer;
+			}
+			if (previousGraph == NULL && graphPath.length > 0)
+			{
+				previousGraph = DependencyGraph::load(graphPath, compiler->pool);
+			}
+		}
+		if (previousGraph != NULL && previousGraph->componentsHash != componentsHash)
+		{
+			previousGraph = NULL;
+		}
+		graph = DependencyGraph::create(componentsHash, compiler->pool);
+	}
 
-					// show output
+	// Tags, classes and ids printed by every layout, so CSS rules that can't match anything are dropped.
+	HashTable<bool>* usedNames = HashTable<bool>::create(256, compiler->pool);
+	s32 previousLayoutCount = 0;
+	for (s32 i = 0; previousGraph != NULL && i < previousGraph->outputs->used; ++i)
+	{
+		if (previousGraph->outputs->data[i]->type == DEPENDENCY_OUTPUT_LAYOUT)
+		{
+			++previousLayoutCount;
+		}
+	}
+	bool isEveryLayoutUpToDate = (previousGraph != NULL && previousLayoutCount == layoutCount);
 
-					print("\n------------------------\n");
-					print("Compiled From: %s", &ast_file->pathname);
-					print("\nCompiled To: %s", &outputPath);
-					print("\n------------------------\n");
-					buffer.print();
-					print("\n");
+	// Compile HTML
+	if (layoutCount > 0)
+	{
+		LayoutWorkQueue queue;
+		zeroMemory(&queue, sizeof(queue));
+		queue.jobs = pushArrayStruct(LayoutJob, layoutCount, compiler->pool);
+		for (s32 i = 0; i < compiler->astFiles->used; ++i)
+		{
+			AST_File* ast_file = &compiler->astFiles->data[i];
+			if (ast_file->layouts != NULL)
+			{
+				for (s32 j = 0; j < ast_file->layouts->used; ++j)
+				{
+					LayoutJob* job = &queue.jobs[queue.jobCount++];
+					job->file = ast_file;
+					job->layout = &ast_file->layouts->data[j];
+					job->layoutIndex = j;
+					job->outputPath = getLayoutOutputPath(compiler, ast_file, compiler->pool);
+					if (previousGraph != NULL)
+					{
+						DependencyOutput* previous = previousGraph->find(DEPENDENCY_OUTPUT_LAYOUT, job->outputPath, j);
+						job->isUpToDate = DependencyGraph::isUpToDate(previous, contentHashes)
+											&& DependencyGraph::isOutputUpToDate(previous, job->outputPath, compiler->isWritingOutput);
+					}
+				}
+			}
+		}
 
+		s32 workerCount = Thread::getProcessorCount();
+		if (workerCount > layoutCount)
+		{
+			workerCount = layoutCount;
+		}
+		LayoutWorker* workers = pushArrayStruct(LayoutWorker, workerCount, compiler->pool);
+		void** workerData = pushArrayStruct(void*, workerCount, compiler->pool);
+		for (s32 i = 0; i < workerCount; ++i)
+		{
+			LayoutWorker* worker = &workers[i];
+			worker->queue = &queue;
+			worker->compiler = *compiler;
+			worker->compiler.pool = AllocatorPool::createFromOS(Megabytes(4));
+			worker->compiler.poolTransient = worker->compiler.pool->create(Megabytes(1));
+			worker->compiler.stack = Array<CompilerParameters*>::create(256, worker->compiler.pool);
+			worker->compiler.expressionStack = pushArrayStruct(CompilerValue, AST_PROGRAM_MAX_STACK_SIZE, worker->compiler.pool);
+			// NOTE: Per worker so expansions don't need locking, they're shared by every layout the worker compiles.
+			worker->compiler.componentExpansions = HashTable<HTML_Expansion>::create(256, worker->compiler.pool);
+			workerData[i] = worker;
+		}
+		Thread::runWorkers(compileLayoutWorkerProc, workerData, workerCount);
 
-					//File::writeEntireFile(outputPath, &buffer);
+		// Merge results in the same order as they'd be compiled serially
+		for (s32 i = 0; i < queue.jobCount; ++i)
+		{
+			LayoutJob* job = &queue.jobs[i];
+			// NOTE: Compile errors are reported as they happen.
+			if (job->hasError)
+			{
+				compiler->hasError = true;
+				freeLayoutWorkers(workers, workerCount);
+				return;
+			}
+			if (job->hasWriteError)
+			{
+				compiler->hasError = true;
+				freeLayoutWorkers(workers, workerCount);
+				return;
+			}
+			if (job->isUpToDate)
+			{
+				DependencyOutput* copy = graph->addCopy(previousGraph->find(DEPENDENCY_OUTPUT_LAYOUT, job->outputPath, job->layoutIndex));
+				for (s32 n = 0; n < copy->names->used; ++n)
+				{
+					*usedNames->findOrAdd(copy->names->data[n]) = true;
+				}
+				print("\nUp to date: %s\n", &job->outputPath);
+				continue;
+			}
+			isEveryLayoutUpToDate = false;
+			DependencyOutput* dependencies = NULL;
+			if (graph != NULL)
+			{
+				dependencies = graph->add(DEPENDENCY_OUTPUT_LAYOUT, job->outputPath, job->layoutIndex);
+				graph->setOutput(dependencies, job->outputPath, compiler->isWritingOutput);
+				graph->addInput(dependencies, job->file->pathname, job->file->contentHash);
+			}
+			// NOTE: Names are copied as they're in the workers pool.
+			for (s32 n = 0; n < job->names->size; ++n)
+			{
+				HashTable<bool>::Entry* entry = &job->names->data[n];
+				if (!entry->isUsed)
+				{
+					continue;
+				}
+				if (dependencies != NULL)
+				{
+					graph->addName(dependencies, entry->key);
+				}
+				if (usedNames->find(entry->key) == NULL)
+				{
+					String name = {};
+					name.data = (char*)pushSizeUninitialized(entry->key.length, compiler->pool);
+					name.length = entry->key.length;
+					memcpy(name.data, entry->key.data, name.length);
+					*usedNames->findOrAdd(name) = true;
+				}
+			}
+			for (s32 c = 0; c < job->componentsUsed->used; ++c)
+			{
+				AST_ComponentDefinition* definition = job->componentsUsed->data[c];
+				addComponentUsed(compiler->componentsUsed, definition);
+				if (dependencies != NULL)
+				{
+					String pathname = compiler->filePathnames->data[definition->name.fileId];
+					graph->addInput(dependencies, pathname, *contentHashes->find(pathname));
 				}
 			}
+			if (job->hasOutput)
+			{
+				// show output
+				print("\n------------------------\n");
+				print("Compiled From: %s", &job->file->pathname);
+				print("\nCompiled To: %s", &job->outputPath);
+				print("\n------------------------\n");
+				printf("%*.*s", job->output.length, job->output.length, job->output.data);
+				print("\n");
+			}
 		}
+		freeLayoutWorkers(workers, workerCount);
 	}
 
 	// Compile CSS
+	// NOTE: Every used components styles go in one stylesheet, so the components used by layouts
+	//		 that were up to date are found from the styles in the previous dependency graph.
+	HashTable<bool>* isComponentUsed = HashTable<bool>::create(compiler->componentsUsed->used + 16, compiler->pool);
 	for (s32 i = 0; i < compiler->componentsUsed->used; ++i)
 	{
-		AST_ComponentDefinition* componentDefintion = compiler->componentsUsed->data[i];
-		if (componentDefintion->style != NULL && componentDefintion->style->rule != NULL)
+		*isComponentUsed->findOrAdd(compiler->componentsUsed->data[i]->name) = true;
+	}
+	s32 previousStyleCount = 0;
+	if (graph != NULL && previousGraph != NULL)
+	{
+		for (s32 i = 0; i < previousGraph->outputs->used; ++i)
 		{
-			CSS_Rule* topRule = componentDefintion->style->rule;
-			topRule = compileStyle(compiler, topRule);
-			if (compiler->hasError)
+			DependencyOutput* previous = previousGraph->outputs->data[i];
+			if (previous->type == DEPENDENCY_OUTPUT_STYLE)
 			{
-				assert(false);
-				return;
+				++previousStyleCount;
+				if (DependencyGraph::isUpToDate(previous, contentHashes))
+				{
+					*isComponentUsed->findOrAdd(previous->name) = true;
+				}
+			}
+		}
+	}
+
+	// Styles are bundled in the order components are defined so the result doesn't depend on
+	// which layouts were compiled.
+	Array<AST_ComponentDefinition*>* styledComponents = Array<AST_ComponentDefinition*>::create(compiler->componentsUsed->used + 16, compiler->pool);
+	for (s32 i = 0; i < compiler->astFiles->used; ++i)
+	{
+		AST_File* ast_file = &compiler->astFiles->data[i];
+		for (s32 j = 0; ast_file->components != NULL && j < ast_file->components->used; ++j)
+		{
+			AST_ComponentDefinition* componentDefintion = &ast_file->components->data[j];
+			if (componentDefintion->style != NULL && componentDefintion->style->rule != NULL
+				&& isComponentUsed->find(componentDefintion->name) != NULL)
+			{
+				if (styledComponents->used == styledComponents->size)
+				{
+					styledComponents->resize(styledComponents->size * 2);
+				}
+				styledComponents->push(componentDefintion);
+			}
+		}
+	}
+
+	// NOTE: Which rules are kept depends on what every layout prints.
+	bool isStyleUpToDate = (isEveryLayoutUpToDate && previousStyleCount == styledComponents->used);
+	String stylePath = getStyleOutputPath(compiler, compiler->pool);
+	if (graph != NULL)
+	{
+		// NOTE: Every style is bundled into 'stylePath', so each one records it as its output.
+		for (s32 i = 0; i < styledComponents->used; ++i)
+		{
+			AST_ComponentDefinition* componentDefintion = styledComponents->data[i];
+			DependencyOutput* previous = NULL;
+			if (previousGraph != NULL)
+			{
+				previous = previousGraph->find(DEPENDENCY_OUTPUT_STYLE, componentDefintion->name);
+			}
+			if (DependencyGraph::isUpToDate(previous, contentHashes)
+				&& DependencyGraph::isOutputUpToDate(previous, stylePath, compiler->isWritingOutput))
+			{
+				graph->addCopy(previous);
+				continue;
+			}
+			isStyleUpToDate = false;
+			String pathname = compiler->filePathnames->data[componentDefintion->name.fileId];
+			DependencyOutput* dependencies = graph->add(DEPENDENCY_OUTPUT_STYLE, componentDefintion->name);
+			graph->setOutput(dependencies, stylePath, compiler->isWritingOutput);
+			graph->addInput(dependencies, pathname, *contentHashes->find(pathname));
+		}
+	}
+
+	if (styledComponents->used > 0)
+	{
+		if (graph != NULL && isStyleUpToDate)
+		{
+			print("\nUp to date: %s\n", &stylePath);
+		}
+		else
+		{
+			Array<CSS_FlatRule>* rules = Array<CSS_FlatRule>::create(256, compiler->pool);
+			for (s32 i = 0; i < styledComponents->used; ++i)
+			{
+				Array<CSS_FlatRule>* componentRules = compileStyle(compiler, styledComponents->data[i]->style->rule);
+				if (compiler->hasError)
+				{
+					assert(false);
+					return;
+				}
+				for (s32 r = 0; r < componentRules->used; ++r)
+				{
+					if (rules->used == rules->size)
+					{
+						rules->resize(rules->size * 2);
+					}
+					rules->push(componentRules->data[r]);
+				}
 			}
+			rules = removeUnusedCSSRules(compiler, rules, usedNames);
+			rules = bundleCSSRules(compiler, groupCSSMediaQueries(compiler, rules));
 
 			TemporaryPoolScope tempPoolScope(compiler->poolTransient);
-			Buffer buffer((s32)Megabytes(4), tempPoolScope);
-			for (s32 i = 0; i < topRule->childRules->used; ++i)
+			if (compiler->isWritingOutput)
 			{
-				CSS_Rule* rule = topRule->childRules->data[i];
-				printCSSRule(buffer, rule);
-				buffer.add("\n");
+				createParentDirectories(stylePath);
+				File::Stream stream = File::openStream(stylePath);
+				if (stream.platformHandle == NULL)
+				{
+					compiler->hasError = true;
+					print("Failed to write: %s\n", &stylePath);
+					return;
+				}
+				Buffer buffer((s32)Kilobytes(64), tempPoolScope, &stream);
+				printCSSFlatRules(buffer, rules, true);
+				buffer.flush();
+				if (!File::closeStream(&stream))
+				{
+					compiler->hasError = true;
+					print("Failed to write: %s\n", &stylePath);
+					return;
+				}
 			}
-			if (buffer.used > 0)
+			else
 			{
+				Buffer buffer((s32)Megabytes(4), tempPoolScope);
+				printCSSFlatRules(buffer, rules);
 				print("\n------------------------\n");
-				print("CSS From: %s\n", &componentDefintion->name);
+				print("Compiled CSS To: %s", &stylePath);
 				print("\n------------------------\n");
 				buffer.print();
 				print("\n\n");
 			}
 		}
 	}
+
+	if (graph != NULL)
+	{
+		compiler->dependencies = graph;
+		if (graphPath.length > 0 && !graph->save(graphPath))
+		{
+			print("Unable to save dependency graph: %s\n", &graphPath);
+		}
+	}
 }
\ No newline at end of file
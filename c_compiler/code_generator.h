@@ -8,9 +8,12 @@
 #include <stdlib.h>
 #include "compiler.h"
 
-#define compileError(format, ...) compiler->hasError = true; print("Compile error: "format"\n", ## __VA_ARGS__); assert(false)
-#define compileErrorSub(format, ...) print("               -- "format"\n", ## __VA_ARGS__)
-#define compileErrorSubSub(format, ...) print("                  "format"\n", ## __VA_ARGS__)
+// NOTE: Use 'compileErrorBegin' and 'compileErrorEnd' to print more about the error first.
+#define compileError(format, ...) compileErrorBegin(format, ## __VA_ARGS__); compileErrorEnd()
+#define compileErrorBegin(format, ...) compiler->hasError = true; print("Compile error: " format "\n", ## __VA_ARGS__)
+#define compileErrorEnd() if (compiler->errorJump != NULL) { longjmp(*compiler->errorJump, 1); } assert(false)
+#define compileErrorSub(format, ...) print("               -- " format "\n", ## __VA_ARGS__)
+#define compileErrorSubSub(format, ...) print("                  " format "\n", ## __VA_ARGS__)
 
 /*enum CompilerContextType {
 	COMPILER_CONTEXT_UNKNOWN = 0,
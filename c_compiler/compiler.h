@@ -1,15 +1,43 @@
 #ifndef COMPILER__INCLUDE
 #define COMPILER__INCLUDE
 
+#include "atom.h"
+#include <setjmp.h>
+
 struct CompilerParameters;
+struct CompilerValue;
+struct DependencyGraph;
+
+struct HTML_Fragment;
+struct HTML_Expansion;
+
+struct ComponentIndexEntry {
+	AST_ComponentDefinition* definition;
+	Array<AST_ComponentDefinition*>* definitions; // Every definition with this name, NULL unless defined more than once
+	bool isStaticChecked;
+	bool isStatic; // Prints the same HTML everywhere it's used, see 'isStaticComponent'
+	HTML_Fragment* fragment; // Pre-rendered layout, set for static components
+};
 
 struct Compiler {
 	bool hasError;
 	Array<AST_File>* astFiles;
+	Array<String>* filePathnames; // Every file seen, indexed by the file ID stored in each Token
+	HashTable<u16>* fileIds; // Index into 'filePathnames' keyed by pathname, see 'getFileId'
+	AtomTable* atoms; // Shared by all threads
 	Array<AST_ComponentDefinition*>* componentsUsed;
+	ComponentIndexEntry* componentIndex; // Built after parsing, indexed by the components name Atom
+	s32 componentIndexCount;
 	String targetDirectory; // the directory to compile, ie. wp-content/themes/fel
 	String outputDirectory; // the directory to output to
+	bool isWritingOutput; // --write or --output, write layouts to 'outputDirectory' rather than printing them
+	String cacheDirectory; // the directory parsed files are cached in, optional
+	bool isWatching; // --watch, keep running and recompile files as they change
+	DependencyGraph* dependencies; // From the last successful compile, set if caching or watching
 	Array<CompilerParameters*>* stack;
+	CompilerValue* expressionStack; // Value stack for running expression programs, AST_PROGRAM_MAX_STACK_SIZE long
+	HashTable<HTML_Expansion>* componentExpansions; // Expanded component layouts keyed by definition and evaluated properties, NULL to disable
+	jmp_buf* errorJump; // Compile errors jump here rather than asserting if set, ie. when watching
 	AllocatorPool* pool;
 	AllocatorPool* poolTransient;
 };
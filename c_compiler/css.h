@@ -31,6 +31,7 @@ struct CSS_Selector_Attribute {
 
 struct CSS_Selector {
 	CSSSelectorType type;
+	bool isCompound; // No whitespace before it, ie. `.b` in `.a.b`, so it's part of the same element as the selector before it
 	union 
 	{
 		// Selector (ie. `.myDiv`, `#main`)
@@ -58,4 +59,19 @@ struct CSS_Rule {
 	CSS_Rule* parent;
 };
 
+// A selector of a nested rule, stored as a chain back through the selector sets of the rules it's
+// nested in. Nested rules share their parents chains rather than copying every selector.
+// ie. `.a, .b { .c {} }` flattens to two chains, `.c` -> `.a` and `.c` -> `.b`
+struct CSS_SelectorChain {
+	Array<CSS_Selector>* selectors; // One selector set of a rule
+	CSS_SelectorChain* parent; // NULL if the rule isn't nested
+};
+
+// A rule with its nesting flattened out, see 'compileStyle'.
+struct CSS_FlatRule {
+	Array<CSS_SelectorChain*>* selectors;
+	Array<CSS_Property>* properties;
+	CSS_Rule* mediaQuery; // @media rule it was inside, NULL if none
+};
+
 #endif
\ No newline at end of file
@@ -3,7 +3,109 @@
 
 #include "css.h"
 
-void printCSSRuleOpen(Buffer& buffer, CSS_Rule* absoluteTopCSSRule)
+void printCSSSelectors(Buffer& buffer, Array<CSS_Selector>* selectors)
+{
+	for (s32 i = 0; i < selectors->used; ++i)
+	{
+		CSS_Selector* selector = &selectors->data[i];
+		if (i != 0 && !selector->isCompound)
+		{
+			buffer.add(' ');
+		}
+		if (selector->type == CSS_SELECTOR_ATTRIBUTE)
+		{
+			buffer.add('[');
+			buffer.add(selector->attribute.name);
+			if (selector->attribute.value.type != TOKEN_UNKNOWN)
+			{
+				buffer.add('=');
+				if (selector->attribute.value.type == TOKEN_STRING) {
+					buffer.add('"');
+					buffer.add(selector->attribute.value);
+					buffer.add('"');
+				} else {
+					buffer.add(selector->attribute.value);
+				}
+			}
+			buffer.add(']');
+		}
+		else
+		{
+			buffer.add(selector->token);
+		}
+	}
+}
+
+// Prints the outermost rules selectors first, ie. `.a .c` for `.c` -> `.a`
+void printCSSSelectorChain(Buffer& buffer, CSS_SelectorChain* chain)
+{
+	if (chain->parent != NULL)
+	{
+		printCSSSelectorChain(buffer, chain->parent);
+		buffer.add(' ');
+	}
+	printCSSSelectors(buffer, chain->selectors);
+}
+
+// If 'minify', only the whitespace that changes the meaning is printed (and no trailing ';').
+void printCSSProperties(Buffer& buffer, Array<CSS_Property>* properties, bool minify = false)
+{
+	if (properties == NULL)
+	{
+		return;
+	}
+	for (s32 p = 0; p < properties->used; ++p)
+	{
+		if (p != 0)
+		{
+			if (minify)
+			{
+				buffer.add(';');
+			}
+			else
+			{
+				buffer.addNewline();
+			}
+		}
+		CSS_Property* cssProperty = &properties->data[p];
+		buffer.add(cssProperty->name);
+		if (minify)
+		{
+			buffer.add(':');
+		}
+		else
+		{
+			buffer.add(": ");
+		}
+		for (s32 i = 0; i < cssProperty->tokens->used; ++i)
+		{
+			if (i != 0)
+			{
+				buffer.add(' ');
+			}
+			CSS_PropertyToken propToken = cssProperty->tokens->data[i];
+			buffer.add(propToken.token);
+			if (propToken.arguments != NULL && propToken.arguments->used > 0)
+			{
+				buffer.add("(");
+				for (s32 i = 0; i < propToken.arguments->used; ++i)
+				{
+					if (i != 0) {
+						buffer.add(",");
+					}
+					buffer.add(propToken.arguments->data[i]);
+				}
+				buffer.add(")");
+			}
+		}
+		if (!minify)
+		{
+			buffer.add(";");
+		}
+	}
+}
+
+void printCSSRuleOpen(Buffer& buffer, CSS_Rule* absoluteTopCSSRule, bool minify = false)
 {
 	if (absoluteTopCSSRule->type == CSS_RULE_MEDIAQUERY)
 	{
@@ -13,7 +115,10 @@ void printCSSRuleOpen(Buffer& buffer, CSS_Rule* absoluteTopCSSRule)
 			if (i != 0)
 			{
 				buffer.add(",");
-				buffer.addNewline();
+				if (!minify)
+				{
+					buffer.addNewline();
+				}
 			}
 			Array<CSS_Selector>* selectors = &absoluteTopCSSRule->selectorSets->data[i];
 			for (s32 i = 0; i < selectors->used; ++i)
@@ -21,9 +126,13 @@ void printCSSRuleOpen(Buffer& buffer, CSS_Rule* absoluteTopCSSRule)
 				CSS_Selector* selector = &selectors->data[i];
 				if (i != 0 && selector->token.type != TOKEN_PAREN_CLOSE && selector->token.type != TOKEN_COLON)
 				{
-					buffer.add(" ");
+					TokenType previousType = selectors->data[i - 1].token.type;
+					if (!minify || (previousType != TOKEN_PAREN_OPEN && previousType != TOKEN_COLON))
+					{
+						buffer.add(" ");
+					}
 				}
-				buffer.add("%s", &selector->token);
+				buffer.add(selector->token);
 			}
 		}
 	}
@@ -32,12 +141,22 @@ void printCSSRuleOpen(Buffer& buffer, CSS_Rule* absoluteTopCSSRule)
 		assert(false);
 	}
 
+	if (minify)
+	{
+		buffer.add("{");
+		return;
+	}
 	buffer.add(" {");
 	++buffer.indent;
 	buffer.addNewline();
 }
 
-void printCSSRuleClose(Buffer& buffer) {
+void printCSSRuleClose(Buffer& buffer, bool minify = false) {
+	if (minify)
+	{
+		buffer.add("}");
+		return;
+	}
 	--buffer.indent;
 	buffer.addNewline();
 	buffer.add("}");
@@ -59,70 +178,14 @@ void printCSSRule(Buffer& buffer, CSS_Rule* absoluteTopCSSRule)
 				buffer.add(',');
 				buffer.addNewline();
 			}
-			Array<CSS_Selector>* selectors = &absoluteTopCSSRule->selectorSets->data[i];
-			for (s32 i = 0; i < selectors->used; ++i)
-			{
-				CSS_Selector* selector = &selectors->data[i];
-				if (i != 0 && selector->type != CSS_SELECTOR_ATTRIBUTE)
-				{
-					buffer.add(' ');
-				}
-				if (selector->type == CSS_SELECTOR_ATTRIBUTE)
-				{
-					buffer.add("[%s=", &selector->attribute.name, &selector->attribute.op);
-					if (selector->attribute.value.type == TOKEN_STRING) {
-						buffer.add("\"%s\"", &selector->attribute.value);
-					} else {
-						buffer.add("%s", &selector->attribute.value);
-					}
-					buffer.add(']');
-					buffer.print();
-				}
-				else
-				{
-					buffer.add("%s", &selector->token);
-				}
-			}
+			printCSSSelectors(buffer, &absoluteTopCSSRule->selectorSets->data[i]);
 		}
 
 		buffer.add(" {");
 		++buffer.indent;
 		buffer.addNewline();
 
-		if (absoluteTopCSSRule->properties != NULL && absoluteTopCSSRule->properties->used > 0)
-		{
-			for (s32 p = 0; p < absoluteTopCSSRule->properties->used; ++p)
-			{
-				if (p != 0)
-				{
-					buffer.addNewline();
-				}
-				CSS_Property* cssProperty = &absoluteTopCSSRule->properties->data[p];
-				buffer.add("%s: ", &cssProperty->name);
-				for (s32 i = 0; i < cssProperty->tokens->used; ++i)
-				{
-					if (i != 0)
-					{
-						buffer.add(' ');
-					}
-					CSS_PropertyToken propToken = cssProperty->tokens->data[i];
-					buffer.add("%s", &propToken.token);
-					if (propToken.arguments != NULL && propToken.arguments->used > 0)
-					{
-						buffer.add("(");
-						for (s32 i = 0; i < propToken.arguments->used; ++i)
-						{
-							if (i != 0) {
-								buffer.add(",");
-							}
-							buffer.add("%s", &propToken.arguments->data[i]);
-						}
-						buffer.add(")");
-					}
-				}
-				buffer.add(";");
-			}
-		}
+		printCSSProperties(buffer, absoluteTopCSSRule->properties);
 	}
 	else if (absoluteTopCSSRule->type == CSS_RULE_MEDIAQUERY)
 	{
@@ -156,6 +219,82 @@ void printCSSRule(Buffer& buffer, CSS_Rule* absoluteTopCSSRule)
 	buffer.add("}");
 }
 
+void printCSSFlatRuleSelectors(Buffer& buffer, CSS_FlatRule* flatRule, bool minify = false)
+{
+	for (s32 i = 0; i < flatRule->selectors->used; ++i)
+	{
+		if (i != 0)
+		{
+			buffer.add(',');
+			if (!minify)
+			{
+				buffer.addNewline();
+			}
+		}
+		printCSSSelectorChain(buffer, flatRule->selectors->data[i]);
+	}
+}
+
+void printCSSFlatRule(Buffer& buffer, CSS_FlatRule* flatRule, bool minify = false)
+{
+	printCSSFlatRuleSelectors(buffer, flatRule, minify);
+	if (minify)
+	{
+		buffer.add('{');
+	}
+	else
+	{
+		buffer.add(" {");
+		++buffer.indent;
+		buffer.addNewline();
+	}
+	printCSSProperties(buffer, flatRule->properties, minify);
+	printCSSRuleClose(buffer, minify);
+}
+
+// Rules next to each other with the same 'mediaQuery' are printed inside one @media block.
+void printCSSFlatRules(Buffer& buffer, Array<CSS_FlatRule>* rules, bool minify = false)
+{
+	CSS_Rule* mediaQuery = NULL;
+	for (s32 i = 0; i < rules->used; ++i)
+	{
+		CSS_FlatRule* rule = &rules->data[i];
+		if (rule->mediaQuery != mediaQuery)
+		{
+			if (mediaQuery != NULL)
+			{
+				printCSSRuleClose(buffer, minify);
+				if (!minify)
+				{
+					buffer.add("\n");
+				}
+			}
+			mediaQuery = rule->mediaQuery;
+			if (mediaQuery != NULL)
+			{
+				printCSSRuleOpen(buffer, mediaQuery, minify);
+			}
+		}
+		else if (mediaQuery != NULL && !minify)
+		{
+			buffer.addNewline();
+		}
+		printCSSFlatRule(buffer, rule, minify);
+		if (mediaQuery == NULL && !minify)
+		{
+			buffer.add("\n");
+		}
+	}
+	if (mediaQuery != NULL)
+	{
+		printCSSRuleClose(buffer, minify);
+		if (!minify)
+		{
+			buffer.add("\n");
+		}
+	}
+}
+
 void printCSSRule(CSS_Rule* cssRule, AllocatorPool* pool)
 {
 	TemporaryPoolScope tempPoolScope(pool);
@@ -0,0 +1,378 @@
+#ifndef DEPENDENCY_GRAPH_INCLUDE
+#define DEPENDENCY_GRAPH_INCLUDE
+
+#include "ast.h"
+#include "file.h"
+#include "hash_table.h"
+
+// NOTE: Bump this whenever the generated HTML/CSS changes so every output is rebuilt once.
+#define DEPENDENCY_GRAPH_VERSION 4
+
+//
+// Records which files each output was built from so the next run only rebuilds outputs whose
+// inputs changed. A layouts inputs are its own file and the files of every component it
+// expanded (including nested ones), a components CSS depends only on the file it's defined in.
+// Layouts also keep the tags, classes and ids they print so unused CSS can still be found when
+// they're up to date. Each output also records where it went, so it's rebuilt if it was only
+// printed, went to another directory or the file was deleted since.
+//
+// Saved as text so it's easy to inspect:
+//		fel-dependencies <version> <components hash>
+//		layout <layout index> <output path>
+//		output <write|print> <output path>
+//		input <content hash> <pathname>
+//		uses <name>
+//		style <component name>
+//		input <content hash> <pathname>
+//
+enum DependencyOutputType {
+	DEPENDENCY_OUTPUT_UNKNOWN = 0,
+	DEPENDENCY_OUTPUT_LAYOUT,
+	DEPENDENCY_OUTPUT_STYLE,
+};
+
+struct DependencyInput {
+	String pathname;
+	u64 contentHash;
+};
+
+struct DependencyOutput {
+	DependencyOutputType type;
+	String name; // Output path for layouts, component name for styles
+	s32 layoutIndex; // A file can have more than one layout
+	Array<DependencyInput>* inputs;
+	Array<String>* names; // Tags, classes and ids a layout prints, see 'addHTMLNames'
+	String outputPath; // File it was compiled to, see 'setOutput'
+	bool isWritten; // Written to 'outputPath', otherwise it was only printed
+	DependencyOutput* next; // Next output with the same name
+};
+
+struct DependencyGraph {
+	// NOTE: Hash of every component name in order. Adding, removing or renaming a component
+	//		 can change which definition an identifier resolves to, so everything is rebuilt.
+	u64 componentsHash;
+	Array<DependencyOutput*>* outputs;
+	HashTable<DependencyOutput*>* outputLookup;
+	AllocatorPool* _pool;
+
+	inline static DependencyGraph* create(u64 componentsHash, AllocatorPool* pool)
+	{
+		DependencyGraph* result = pushStruct(DependencyGraph, pool);
+		result->componentsHash = componentsHash;
+		result->outputs = Array<DependencyOutput*>::create(256, pool);
+		result->outputLookup = HashTable<DependencyOutput*>::create(256, pool);
+		result->_pool = pool;
+		return result;
+	}
+
+	inline DependencyOutput* find(DependencyOutputType type, String name, s32 layoutIndex = 0)
+	{
+		DependencyOutput** first = outputLookup->find(name);
+		if (first == NULL)
+		{
+			return NULL;
+		}
+		for (DependencyOutput* output = *first; output != NULL; output = output->next)
+		{
+			if (output->type == type && output->layoutIndex == layoutIndex)
+			{
+				return output;
+			}
+		}
+		return NULL;
+	}
+
+	// NOTE: 'name' is copied, a components name points into its file which is unmapped when watching.
+	inline DependencyOutput* add(DependencyOutputType type, String name, s32 layoutIndex = 0)
+	{
+		assert(find(type, name, layoutIndex) == NULL);
+		name = copyString(name);
+		DependencyOutput* output = pushStruct(DependencyOutput, _pool);
+		output->type = type;
+		output->name = name;
+		output->layoutIndex = layoutIndex;
+		output->inputs = Array<DependencyInput>::create(8, _pool);
+		output->names = Array<String>::create(16, _pool);
+		DependencyOutput** first = outputLookup->findOrAdd(name);
+		output->next = *first;
+		*first = output;
+		if (outputs->used == outputs->size)
+		{
+			outputs->resize(outputs->size * 2);
+		}
+		outputs->push(output);
+		return output;
+	}
+
+	// Copy an output from a previous graph as-is, ie. it was up to date and so wasn't rebuilt.
+	// NOTE: Names are copied as the previous graph may be freed, pathnames are owned by the files.
+	inline DependencyOutput* addCopy(DependencyOutput* previous)
+	{
+		DependencyOutput* output = add(previous->type, previous->name, previous->layoutIndex);
+		setOutput(output, previous->outputPath, previous->isWritten);
+		for (s32 i = 0; i < previous->inputs->used; ++i)
+		{
+			addInput(output, previous->inputs->data[i].pathname, previous->inputs->data[i].contentHash);
+		}
+		for (s32 i = 0; i < previous->names->used; ++i)
+		{
+			addName(output, previous->names->data[i]);
+		}
+		return output;
+	}
+
+	// NOTE: 'outputPath' is copied.
+	inline void setOutput(DependencyOutput* output, String outputPath, bool isWritten)
+	{
+		output->outputPath = copyString(outputPath);
+		output->isWritten = isWritten;
+	}
+
+	// NOTE: 'name' is copied.
+	inline void addName(DependencyOutput* output, String name)
+	{
+		if (output->names->used == output->names->size)
+		{
+			output->names->resize(output->names->size * 2);
+		}
+		output->names->push(copyString(name));
+	}
+
+	inline void addInput(DependencyOutput* output, String pathname, u64 contentHash)
+	{
+		for (s32 i = 0; i < output->inputs->used; ++i)
+		{
+			if (output->inputs->data[i].pathname.cmp(pathname))
+			{
+				return;
+			}
+		}
+		if (output->inputs->used == output->inputs->size)
+		{
+			output->inputs->resize(output->inputs->size * 2);
+		}
+		DependencyInput input = {};
+		input.pathname = pathname;
+		input.contentHash = contentHash;
+		output->inputs->push(input);
+	}
+
+	// 'contentHashes' is the content hash of every file in this run, keyed by pathname.
+	inline static bool isUpToDate(DependencyOutput* output, HashTable<u64>* contentHashes)
+	{
+		if (output == NULL || output->inputs->used == 0)
+		{
+			return false;
+		}
+		for (s32 i = 0; i < output->inputs->used; ++i)
+		{
+			DependencyInput* input = &output->inputs->data[i];
+			u64* contentHash = contentHashes->find(input->pathname);
+			if (contentHash == NULL || *contentHash != input->contentHash)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Checks the output went to the same place as it would now and, if it was written, that the file is still there.
+	inline static bool isOutputUpToDate(DependencyOutput* output, String outputPath, bool isWritten)
+	{
+		if (output == NULL || output->isWritten != isWritten || !output->outputPath.cmp(outputPath))
+		{
+			return false;
+		}
+		return !isWritten || File::exists(outputPath);
+	}
+
+	// Returns false if the file couldn't be written, the next run will then rebuild everything.
+	bool save(String path)
+	{
+		char cPath[1024];
+		char cTempPath[1024];
+		s32 pathLength = snprintf(cPath, sizeof(cPath), "%.*s", path.length, path.data);
+		s32 tempPathLength = snprintf(cTempPath, sizeof(cTempPath), "%.*s.tmp", path.length, path.data);
+		if (pathLength < 0 || pathLength >= (s32)sizeof(cPath)
+			|| tempPathLength < 0 || tempPathLength >= (s32)sizeof(cTempPath))
+		{
+			return false;
+		}
+
+		FILE* f = fopen(cTempPath, "wb");
+		if (f == NULL)
+		{
+			return false;
+		}
+		fprintf(f, "fel-dependencies %d %016llx\n", DEPENDENCY_GRAPH_VERSION, (unsigned long long)componentsHash);
+		for (s32 i = 0; i < outputs->used; ++i)
+		{
+			DependencyOutput* output = outputs->data[i];
+			if (output->type == DEPENDENCY_OUTPUT_LAYOUT)
+			{
+				fprintf(f, "layout %d %.*s\n", output->layoutIndex, output->name.length, output->name.data);
+			}
+			else
+			{
+				assert(output->type == DEPENDENCY_OUTPUT_STYLE);
+				fprintf(f, "style %.*s\n", output->name.length, output->name.data);
+			}
+			if (output->outputPath.length > 0)
+			{
+				fprintf(f, "output %s %.*s\n", output->isWritten ? "write" : "print", output->outputPath.length, output->outputPath.data);
+			}
+			for (s32 j = 0; j < output->inputs->used; ++j)
+			{
+				DependencyInput* input = &output->inputs->data[j];
+				fprintf(f, "input %016llx %.*s\n", (unsigned long long)input->contentHash, input->pathname.length, input->pathname.data);
+			}
+			for (s32 j = 0; j < output->names->used; ++j)
+			{
+				fprintf(f, "uses %.*s\n", output->names->data[j].length, output->names->data[j].data);
+			}
+		}
+		bool isValid = ferror(f) == 0;
+		isValid = (fclose(f) == 0) && isValid;
+		if (!isValid)
+		{
+			remove(cTempPath);
+			return false;
+		}
+		remove(cPath);
+		return rename(cTempPath, cPath) == 0;
+	}
+
+	// Returns NULL if there's no previous graph or it was written by a different version.
+	// NOTE: Strings point into the mapped file, which is never unmapped.
+	static DependencyGraph* load(String path, AllocatorPool* pool)
+	{
+		char cPath[1024];
+		s32 pathLength = snprintf(cPath, sizeof(cPath), "%.*s", path.length, path.data);
+		if (pathLength < 0 || pathLength >= (s32)sizeof(cPath))
+		{
+			return NULL;
+		}
+		FILE* f = fopen(cPath, "rb");
+		if (f == NULL)
+		{
+			return NULL;
+		}
+		fclose(f);
+
+		String contents = File::mapEntireFile(path);
+		if (contents.data == NULL)
+		{
+			return NULL;
+		}
+
+		DependencyGraph* graph = NULL;
+		DependencyOutput* output = NULL;
+		char* at = contents.data;
+		char* end = contents.data + contents.length;
+		while (at < end)
+		{
+			char* line = at;
+			while (at < end && *at != '\n')
+			{
+				++at;
+			}
+			String rest = {};
+			rest.data = line;
+			rest.length = (s32)(at - line);
+			++at;
+
+			String keyword = nextWord(&rest);
+			if (graph == NULL)
+			{
+				// Header
+				s32 version = (s32)strtol(nextWord(&rest).data, NULL, 10);
+				u64 componentsHash = (u64)strtoull(nextWord(&rest).data, NULL, 16);
+				if (!keyword.cmp("fel-dependencies") || version != DEPENDENCY_GRAPH_VERSION)
+				{
+					return NULL;
+				}
+				graph = create(componentsHash, pool);
+			}
+			else if (keyword.cmp("layout"))
+			{
+				s32 layoutIndex = (s32)strtol(nextWord(&rest).data, NULL, 10);
+				if (rest.length == 0 || graph->find(DEPENDENCY_OUTPUT_LAYOUT, rest, layoutIndex) != NULL)
+				{
+					return NULL;
+				}
+				output = graph->add(DEPENDENCY_OUTPUT_LAYOUT, rest, layoutIndex);
+			}
+			else if (keyword.cmp("style"))
+			{
+				if (rest.length == 0 || graph->find(DEPENDENCY_OUTPUT_STYLE, rest) != NULL)
+				{
+					return NULL;
+				}
+				output = graph->add(DEPENDENCY_OUTPUT_STYLE, rest);
+			}
+			else if (keyword.cmp("output") && output != NULL)
+			{
+				String mode = nextWord(&rest);
+				if (rest.length == 0 || (!mode.cmp("write") && !mode.cmp("print")))
+				{
+					return NULL;
+				}
+				graph->setOutput(output, rest, mode.cmp("write"));
+			}
+			else if (keyword.cmp("input") && output != NULL)
+			{
+				u64 contentHash = (u64)strtoull(nextWord(&rest).data, NULL, 16);
+				if (rest.length == 0)
+				{
+					return NULL;
+				}
+				graph->addInput(output, rest, contentHash);
+			}
+			else if (keyword.cmp("uses") && output != NULL && rest.length > 0)
+			{
+				graph->addName(output, rest);
+			}
+			else if (keyword.length > 0)
+			{
+				// Corrupt graph
+				return NULL;
+			}
+		}
+		return graph;
+	}
+
+private:
+	inline String copyString(String string)
+	{
+		String result = {};
+		result.length = string.length;
+		result.data = (char*)pushSizeUninitialized(string.length, _pool);
+		memcpy(result.data, string.data, string.length);
+		return result;
+	}
+
+	// Splits off the next space separated word, 'rest' is left as everything after the space.
+	inline static String nextWord(String* rest)
+	{
+		String word = *rest;
+		word.length = 0;
+		while (word.length < rest->length && rest->data[word.length] != ' ')
+		{
+			++word.length;
+		}
+		if (word.length < rest->length)
+		{
+			// Skip space
+			rest->data += word.length + 1;
+			rest->length -= word.length + 1;
+		}
+		else
+		{
+			rest->data += word.length;
+			rest->length = 0;
+		}
+		return word;
+	}
+};
+
+#endif
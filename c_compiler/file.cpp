@@ -48,6 +48,13 @@ namespace File
 		assert(buffer->used >= 0);
 
 		char cFilename[260];
+		if (filename.length >= (s32)ArrayCount(cFilename))
+		{
+			if (error) {
+				error->errorCode = FILE_CANT_OPEN;
+			}
+			return;
+		}
 		filename.toCString(cFilename, ArrayCount(cFilename));
 
 		FILE* f = fopen(cFilename, "wb");
@@ -20,7 +20,30 @@ namespace File
 	};
 
 	String readEntireFile(String filepath, Error* error = NULL);
+	// Maps the file into memory (null terminated) where the platform supports it, otherwise
+	// falls back to 'readEntireFile'. The result stays valid until 'unmapEntireFile'.
+	// If 'writable', changes to the memory are private to this process and never written back.
+	String mapEntireFile(String filepath, Error* error = NULL, bool writable = false);
+	// Frees the result of 'mapEntireFile', does nothing if it failed.
+	void unmapEntireFile(String contents);
 	void writeEntireFile(String filename, Buffer* buffer, Error* error = NULL);
+	// Returns true if 'filename' is an existing file (not a directory).
+	bool exists(String filename);
+
+	// A file that's written as data becomes available rather than all at once, see Buffer::flush.
+	struct Stream {
+		void* platformHandle;
+		String filename; // Not copied, must stay valid until 'closeStream'
+		bool hasError; // Set if any write failed
+	};
+
+	// Writes to '<filename>.tmp', which 'closeStream' moves over 'filename' if every write succeeded, so
+	// a failed compile never leaves a truncated file behind. On failure the result has no 'platformHandle'.
+	Stream openStream(String filename, Error* error = NULL);
+	// Writes each part in order, in a single call where the platform supports it (writev).
+	void writeStream(Stream* stream, String* parts, s32 partCount);
+	// Returns false if any write failed, in which case 'filename' is left untouched.
+	bool closeStream(Stream* stream);
 }
 
 namespace Directory
@@ -29,6 +52,7 @@ namespace Directory
 		DIRECTORY_NO_ERROR = 0,
 		DIRECTORY_NO_FILES = 1,
 		DIRECTORY_INVALID_DIR = 2,
+		DIRECTORY_CANT_WATCH = 3,
 	};
 
 	struct Error {
@@ -36,6 +60,18 @@ namespace Directory
 	};
 
 	StringLinkedList getFilesRecursive(AllocatorPool* pool, String directory, Error* error = NULL);
+	// Returns true if the directory exists or was created.
+	bool create(String directory);
+
+	// Platform specific, see 'watch'.
+	struct Watcher;
+
+	// Watches 'directory' and everything under it for changes. Returns NULL on failure.
+	Watcher* watch(String directory, AllocatorPool* pool);
+	// Blocks until files under the directory are written, moved or deleted, then returns each
+	// changed file once. Pathnames are allocated on 'pool'. If waiting fails 'error' is set to
+	// DIRECTORY_CANT_WATCH, the watcher is then unusable.
+	StringLinkedList waitForChanges(Watcher* watcher, AllocatorPool* pool, Error* error = NULL);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef HASH_TABLE_INCLUDE
+#define HASH_TABLE_INCLUDE
+
+#include "string.h"
+
+// FNV-1a
+inline u32 hashString(String string)
+{
+	u32 hash = 2166136261u;
+	for (s32 i = 0; i < string.length; ++i)
+	{
+		hash ^= (u8)string.data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// FNV-1a (64-bit), for when collisions must be unlikely enough to treat equal hashes as equal contents.
+inline u64 hashString64(String string, u64 seed = 0)
+{
+	u64 hash = 14695981039346656037ull ^ seed;
+	for (s32 i = 0; i < string.length; ++i)
+	{
+		hash ^= (u8)string.data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Open addressing hash table keyed by String. Keys are not copied so they must
+// outlive the table.
+template <typename T>
+struct HashTable {
+	struct Entry {
+		bool isUsed;
+		u32 hash;
+		String key;
+		T value;
+	};
+
+	s32 size; // always a power of 2
+	s32 used;
+	Entry* data;
+	AllocatorPool* _pool;
+
+	inline static HashTable* create(s32 size, AllocatorPool* pool) {
+		assert(size > 0);
+		HashTable* result = pushStruct(HashTable, pool);
+		result->_pool = pool;
+		result->size = 1;
+		while (result->size < size)
+		{
+			result->size *= 2;
+		}
+		result->data = pushArrayStruct(Entry, result->size, pool);
+		return result;
+	}
+	inline T* find(String key) {
+		return find(key, hashString(key));
+	}
+	inline T* find(String key, u32 hash) {
+		Entry* entry = findEntry(key, hash);
+		if (!entry->isUsed)
+		{
+			return NULL;
+		}
+		return &entry->value;
+	}
+	// Returns the existing value for the key or adds a zeroed one.
+	inline T* findOrAdd(String key, bool* wasAdded = NULL) {
+		return findOrAdd(key, hashString(key), wasAdded);
+	}
+	inline T* findOrAdd(String key, u32 hash, bool* wasAdded = NULL) {
+		Entry* entry = findEntry(key, hash);
+		if (wasAdded) {
+			*wasAdded = !entry->isUsed;
+		}
+		if (!entry->isUsed)
+		{
+			// Keep load factor under 75%
+			if ((used + 1) * 4 > size * 3)
+			{
+				grow();
+				entry = findEntry(key, hash);
+			}
+			entry->isUsed = true;
+			entry->hash = hash;
+			entry->key = key;
+			++used;
+		}
+		return &entry->value;
+	}
+private:
+	inline Entry* findEntry(String key, u32 hash) {
+		u32 mask = (u32)size - 1;
+		for (u32 i = hash & mask;; i = (i + 1) & mask)
+		{
+			Entry* entry = &data[i];
+			if (!entry->isUsed || (entry->hash == hash && entry->key.cmp(key)))
+			{
+				return entry;
+			}
+		}
+	}
+	inline void grow() {
+		Entry* oldData = data;
+		s32 oldSize = size;
+		size *= 2;
+		data = pushArrayStruct(Entry, size, _pool);
+		u32 mask = (u32)size - 1;
+		for (s32 i = 0; i < oldSize; ++i)
+		{
+			Entry* oldEntry = &oldData[i];
+			if (oldEntry->isUsed)
+			{
+				u32 j = oldEntry->hash & mask;
+				while (data[j].isUsed)
+				{
+					j = (j + 1) & mask;
+				}
+				data[j] = *oldEntry;
+			}
+		}
+	}
+};
+
+#endif
@@ -19,6 +19,7 @@ enum HTML_Types {
 	HTML_ROOT,
 	HTML_ELEMENT_VIRTUAL,
 	HTML_CHILDREN,
+	HTML_STATIC,
 };
 
 struct HTML {
@@ -61,6 +62,25 @@ struct HTML_Root : HTML_Element {
 	HTML_Element* childInsertionElement; // Denoted by 'children' keyword, hints to where to insert child elements
 };
 
+// Pre-rendered HTML of a static component, printed once and then copied in wherever it's used.
+struct HTML_Fragment {
+	String html; // Printed at indent 0
+	Array<s32>* newlines; // Offset of each newline that gets the current indent added when copied in
+	Array<AST_ComponentDefinition*>* componentsUsed; // The component and every component nested in it
+	HTML_Element* tree; // What was printed, see 'addHTMLNames'
+};
+
+struct HTML_Static : HTML {
+	HTML_Fragment* fragment;
+};
+
+// Expanded layout of a component, shared by every use with the same evaluated properties and no children.
+// NOTE: Must not be modified once added, it's in the HTML tree more than once.
+struct HTML_Expansion {
+	HTML_Element* html;
+	Array<AST_ComponentDefinition*>* componentsUsed; // Every component nested in it
+};
+
 inline HTML* setupHTMLType_(HTML* html_top, HTML_Types type, AllocatorPool* pool)
 {
 	html_top->type = type;
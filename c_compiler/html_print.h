@@ -10,21 +10,24 @@ void printPostfixToInfix(Buffer* buffer, Array<CompilerValue>* expression);
 inline void printCompilerValue(Buffer* buffer, CompilerValue value) {
 	if (value.type == COMPILER_VALUE_TYPE_DOUBLE)
 	{
-		buffer->add("%f", value.valueDouble);
+		buffer->addDouble(value.valueDouble);
 	}
 	else if (value.type == COMPILER_VALUE_TYPE_STRING)
 	{
-		buffer->add("\"%s\"", &value.valueString);
+		buffer->add('"');
+		buffer->add(value.valueString);
+		buffer->add('"');
 	}
 	else if (value.type == COMPILER_VALUE_TYPE_BACKEND_IDENTIFIER)
 	{
 		if (value.valueToken.isFunction) 
 		{
-			buffer->add("%s()", &value.valueToken);
+			buffer->add(value.valueToken.name);
+			buffer->add("()");
 		}
 		else
 		{
-			buffer->add("%s", &value.valueToken);
+			buffer->add(value.valueToken.name);
 		}
 	}
 	else if (value.type == COMPILER_VALUE_TYPE_BACKEND_EXPRESSION)
@@ -35,7 +38,7 @@ inline void printCompilerValue(Buffer* buffer, CompilerValue value) {
 	}
 	else if (value.type == COMPILER_VALUE_TYPE_BACKEND_OPERATOR)
 	{
-		buffer->add("%s", &value.valueToken);
+		buffer->add(value.valueToken.name);
 	}
 	else
 	{
@@ -126,6 +129,25 @@ inline void printPostfixToInfix(Buffer* buffer, Array<CompilerValue>* expression
 	assert(stackOp.used == 0);
 }
 
+// Copies in pre-rendered HTML, adding the current indent after each of its newlines.
+inline void printHTMLFragment(Buffer& buffer, HTML_Fragment* fragment)
+{
+	String run = fragment->html;
+	s32 start = 0;
+	for (s32 i = 0; i < fragment->newlines->used; ++i)
+	{
+		s32 end = fragment->newlines->data[i] + 1; // Include the newline
+		run.data = fragment->html.data + start;
+		run.length = end - start;
+		buffer.add(run);
+		buffer.addIndent();
+		start = end;
+	}
+	run.data = fragment->html.data + start;
+	run.length = fragment->html.length - start;
+	buffer.add(run);
+}
+
 void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 	assert(absoluteTopHTML != NULL);
 
@@ -152,7 +174,9 @@ void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 						--buffer.indent;
 						buffer.addNewline();
 					}
-					buffer.add("</%s>", &ast->name);
+					buffer.add("</");
+					buffer.add(ast->name);
+					buffer.add('>');
 					buffer.addNewline();
 				}
 				break;
@@ -200,7 +224,8 @@ void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 			{
 				HTML_Element* ast = (HTML_Element*)top;
 				//printf("<%*.*s", ast->name.length, ast->name.length, ast->name.data);
-				buffer.add("<%s", &ast->name);
+				buffer.add('<');
+				buffer.add(ast->name);
 				if (ast->parameters != NULL && ast->parameters->names != NULL && ast->parameters->names->used > 0)
 				{
 					assert(ast->parameters->values != NULL);
@@ -213,7 +238,11 @@ void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 						CompilerValue compileValue = ast->parameters->values->data[i];
 						assert(compileValue.type == COMPILER_VALUE_TYPE_STRING);
 						String* value = &compileValue.valueString;
-						buffer.add(" %s=\"%s\"", name, value);
+						buffer.add(' ');
+						buffer.add(*name);
+						buffer.add("=\"");
+						buffer.add(*value);
+						buffer.add('"');
 					}
 					buffer.add(">");
 				}
@@ -230,7 +259,7 @@ void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 
 			case HTML_TEXT:
 			{
-				buffer.add("%s", top->name);
+				buffer.add(top->name);
 				buffer.addNewline();
 			} 
 			break;
@@ -240,7 +269,9 @@ void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 				// NOTE(Jake): I want to make the backend output configurable in the language in
 				//			   the future, for now just support PHP.
 				HTML_Backend_Function* ast = (HTML_Backend_Function*)top;
-				buffer.add("<?php %s(", &ast->name);
+				buffer.add("<?php ");
+				buffer.add(ast->name);
+				buffer.add('(');
 				if (ast->parameters != NULL)
 				{
 					if (ast->parameters->names->used == 0 && ast->parameters->values->used > 0)
@@ -268,7 +299,9 @@ void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 			case HTML_BACKEND_IDENTIFIER:
 			{
 				HTML* ast = (HTML*)top;
-				buffer.add("<?php echo $%s; ?>", &ast->name);
+				buffer.add("<?php echo $");
+				buffer.add(ast->name);
+				buffer.add("; ?>");
 				buffer.addNewline();
 			}
 			break;
@@ -303,6 +336,13 @@ void printHTML(Buffer& buffer, HTML_Element* absoluteTopHTML) {
 				// NOTE: add children below
 			break;
 
+			case HTML_STATIC:
+			{
+				HTML_Static* ast = (HTML_Static*)top;
+				printHTMLFragment(buffer, ast->fragment);
+			}
+			break;
+
 			default:
 				printf("[HTML_not_printable_yet]");
 				assert(false);
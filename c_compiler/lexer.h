@@ -3,49 +3,109 @@
 
 #include "tokens.h"
 #include "array.h"
+#include <setjmp.h>
 
-#define lexError(token, format, ...) printf("Parse error(%d,%d): "format"\n", token.lineNumber, __LINE__, ## __VA_ARGS__)
+#define lexError(token, format, ...) printf("Parse error(%d,%d): " format "\n", token.lineNumber, __LINE__, ## __VA_ARGS__)
 
 struct TokenizerState {
 	char* at;
 	u32 lineNumber;
 };
 
+enum GetTokenFlags {
+	GET_TOKEN_NO_FLAGS = 0,
+	GET_TOKEN_ACCEPT_NEWLINE = 1,
+};
+
+enum TokenizerMode {
+	TOKENIZER_MODE_FEL = 0, // getToken
+	TOKENIZER_MODE_CSS_PROPERTY, // getTokenCSSProperty
+};
+
+// Number of recently lexed tokens kept, see 'TokenizerLookahead'
+#define TOKENIZER_LOOKAHEAD_COUNT 4
+
+// A token that's already been lexed, keyed by where lexing started. The parser peeks constantly
+// and rewinds 'state' to re-read tokens, this lets the next get/peek at the same spot reuse the
+// token rather than lex it again.
+// NOTE: The whole file can't be lexed up front as how a token is lexed depends on what the parser
+//		 is reading, ie. CSS properties and newlines.
+struct TokenizerLookahead {
+	char* at; // NULL if unused
+	TokenizerMode mode;
+	GetTokenFlags flags;
+	Token token;
+	TokenizerState endState;
+};
+
 struct Tokenizer {
 	TokenizerState state;
 	String string;
-	String pathName;
+	u16 fileId;
+	AtomTable* atoms;
 	AllocatorPool* pool;
 	AllocatorPool* poolTransient;
+	TokenizerLookahead lookahead[TOKENIZER_LOOKAHEAD_COUNT];
+	s32 lookaheadNext; // Oldest entry, replaced next
+	jmp_buf* errorJump; // Parse errors jump here rather than asserting if set, see 'parseFile'
 
 	// Debugging vars
 	Token lastGetToken;
 	Token currGetToken;
 };
 
-enum GetTokenFlags {
-	GET_TOKEN_NO_FLAGS = 0,
-	GET_TOKEN_ACCEPT_NEWLINE = 1,
+// NOTE: Parse errors stop in the debugger unless the tokenizer has somewhere to jump to, ie. when watching.
+#define tokenizerErrorJump(tokenizer) if ((tokenizer)->errorJump != NULL) { longjmp(*(tokenizer)->errorJump, 1); } assert(false)
+
+//
+// Character classes
+//
+enum LexerCharClass {
+	CHAR_WHITESPACE = 1 << 0, // ' ', '\t', '\v', '\f'
+	CHAR_END_OF_LINE = 1 << 1, // '\n', '\r'
+	CHAR_ALPHA = 1 << 2,
+	CHAR_NUMBER = 1 << 3,
+	CHAR_IDENTIFIER = 1 << 4, // Continues an identifier, alpha, number, '_' or '.'
+	CHAR_CSS_IDENTIFIER = 1 << 5, // Continues a CSS identifier, alpha, number, '_' or '-'
+};
+
+global_variable const u8 lexerCharClass[256] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x01, 0x01, 0x02, 0x00, 0x00, // 0x00 - 0x0F
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0x10 - 0x1F
+	0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x10, 0x00, // 0x20 - 0x2F !"#$%&'()*+,-./
+	0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0x30 - 0x3F 0123456789:;<=>?
+	0x00, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, // 0x40 - 0x4F @ABCDEFGHIJKLMNO
+	0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x00, 0x00, 0x00, 0x00, 0x30, // 0x50 - 0x5F PQRSTUVWXYZ[\]^_
+	0x00, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, // 0x60 - 0x6F `abcdefghijklmno
+	0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x34, 0x00, 0x00, 0x00, 0x00, 0x00, // 0x70 - 0x7F pqrstuvwxyz{|}~
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0x80 - 0x8F
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0x90 - 0x9F
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xA0 - 0xAF
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xB0 - 0xBF
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xC0 - 0xCF
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xD0 - 0xDF
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xE0 - 0xEF
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xF0 - 0xFF
 };
 
+inline internal bool isCharClass(char C, u8 charClass)
+{
+	return (lexerCharClass[(u8)C] & charClass) != 0;
+}
+
 inline internal bool isEndOfLine(char C)
 {
-    return ((C == '\n') ||
-           (C == '\r'));
+	return isCharClass(C, CHAR_END_OF_LINE);
 }
 
 inline internal bool isWhitespace(char C)
 {
-    return ((C == ' ') ||
-			(C == '\t') ||
-			(C == '\v') ||
-			(C == '\f'));
+	return isCharClass(C, CHAR_WHITESPACE);
 }
 
 inline internal bool isAlpha(char C)
 {
-	return (((C >= 'a') && (C <= 'z')) ||
-           ((C >= 'A') && (C <= 'Z')));
+	return isCharClass(C, CHAR_ALPHA);
 }
 
 inline internal bool isAlphaUnderscoreDash(char C)
@@ -55,12 +115,182 @@ inline internal bool isAlphaUnderscoreDash(char C)
 
 inline internal bool isNumber(char C)
 {
-    return ((C >= '0') && (C <= '9'));
+	return isCharClass(C, CHAR_NUMBER);
 }
 
 inline internal bool isDecimalNumber(char C)
 {
-    return isNumber(C) || C == '.';
+	return isNumber(C) || C == '.';
+}
+
+//
+// Scanning
+//
+// These skip over runs of bytes 16 at a time and leave anything that needs care (escapes, '\r',
+// the end of the file) to the byte at a time code after them. They never read past 'end', so the
+// last few bytes of a file are always handled one at a time.
+//
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEXER_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+inline internal u32 findFirstSetBit(u32 mask)
+{
+	assert(mask != 0);
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (u32)index;
+#else
+	return (u32)__builtin_ctz(mask);
+#endif
+}
+
+inline internal u32 countSetBits(u32 mask)
+{
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+// Mask of the bytes in 'lo' to 'hi', only for ASCII ranges as the compare is signed.
+inline internal __m128i sse2InRange(__m128i chars, char lo, char hi)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8(hi + 1)));
+}
+
+inline internal u32 sse2Match(__m128i chars, char c)
+{
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, _mm_set1_epi8(c)));
+}
+#endif
+
+// Skips identifier characters, 'extraChar' is the one non-alphanumeric character allowed besides '_'.
+inline internal char* scanIdentifier(char* at, char* end, char extraChar)
+{
+#if LEXER_SSE2
+	while (at + 16 <= end)
+	{
+		__m128i chars = _mm_loadu_si128((__m128i*)at);
+		__m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+		u32 mask = (u32)_mm_movemask_epi8(_mm_or_si128(sse2InRange(lower, 'a', 'z'), sse2InRange(chars, '0', '9')))
+					| sse2Match(chars, '_') | sse2Match(chars, extraChar);
+		if (mask != 0xFFFF)
+		{
+			return at + findFirstSetBit(~mask & 0xFFFF);
+		}
+		at += 16;
+	}
+#endif
+	return at;
+}
+
+// Skips to the first '"', '\\' or null in a string body.
+inline internal char* scanString(char* at, char* end)
+{
+#if LEXER_SSE2
+	while (at + 16 <= end)
+	{
+		__m128i chars = _mm_loadu_si128((__m128i*)at);
+		u32 mask = sse2Match(chars, '"') | sse2Match(chars, '\\') | sse2Match(chars, '\0');
+		if (mask != 0)
+		{
+			return at + findFirstSetBit(mask);
+		}
+		at += 16;
+	}
+#endif
+	return at;
+}
+
+// Skips to the first newline or null, ie. the end of a line comment.
+inline internal char* scanToEndOfLine(char* at, char* end)
+{
+#if LEXER_SSE2
+	while (at + 16 <= end)
+	{
+		__m128i chars = _mm_loadu_si128((__m128i*)at);
+		u32 mask = sse2Match(chars, '\n') | sse2Match(chars, '\r') | sse2Match(chars, '\0');
+		if (mask != 0)
+		{
+			return at + findFirstSetBit(mask);
+		}
+		at += 16;
+	}
+#endif
+	return at;
+}
+
+#if LEXER_SSE2
+// Skips bytes that aren't in 'stopMask' and adds the '\n's skipped to 'lineNumber'.
+// NOTE: '\r' must be in 'stopMask'. A '\n' right before a '\r' isn't skipped, as '\n\r' counts as one line.
+inline internal char* sse2SkipCountingLines(char* at, __m128i chars, u32 stopMask, u32* lineNumber)
+{
+	u32 newlineMask = sse2Match(chars, '\n');
+	u32 count = 16;
+	if (stopMask != 0)
+	{
+		count = findFirstSetBit(stopMask);
+	}
+	if (count > 0 && (newlineMask & (1 << (count - 1))) != 0 && (count == 16 || at[count] == '\r'))
+	{
+		--count;
+	}
+	*lineNumber += countSetBits(newlineMask & ((1 << count) - 1));
+	return at + count;
+}
+#endif
+
+// Skips whitespace and, if 'eatNewline', newlines other than '\r'.
+inline internal char* scanWhitespace(char* at, char* end, bool eatNewline, u32* lineNumber)
+{
+#if LEXER_SSE2
+	while (at + 16 <= end)
+	{
+		__m128i chars = _mm_loadu_si128((__m128i*)at);
+		__m128i skip = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), sse2InRange(chars, '\t', '\f'));
+		skip = _mm_andnot_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')), skip);
+		if (eatNewline)
+		{
+			skip = _mm_or_si128(skip, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')));
+		}
+		u32 stopMask = ~(u32)_mm_movemask_epi8(skip) & 0xFFFF;
+		char* next = sse2SkipCountingLines(at, chars, stopMask, lineNumber);
+		if (next < at + 16)
+		{
+			return next;
+		}
+		at = next;
+	}
+#endif
+	return at;
+}
+
+// Skips to the first '*', '/', '\r' or null in a block comment.
+inline internal char* scanBlockComment(char* at, char* end, u32* lineNumber)
+{
+#if LEXER_SSE2
+	while (at + 16 <= end)
+	{
+		__m128i chars = _mm_loadu_si128((__m128i*)at);
+		u32 stopMask = sse2Match(chars, '*') | sse2Match(chars, '/') | sse2Match(chars, '\r') | sse2Match(chars, '\0');
+		char* next = sse2SkipCountingLines(at, chars, stopMask, lineNumber);
+		if (next < at + 16)
+		{
+			return next;
+		}
+		at = next;
+	}
+#endif
+	return at;
+}
+
+inline internal char* getTokenizerEnd(Tokenizer* tokenizer)
+{
+	return tokenizer->string.data + tokenizer->string.length;
 }
 
 inline internal Token getString(Token token, Tokenizer* tokenizer)
@@ -68,9 +298,14 @@ inline internal Token getString(Token token, Tokenizer* tokenizer)
 	token.type = TOKEN_STRING;
     token.data = tokenizer->state.at;
             
-    while(tokenizer->state.at[0] &&
-            tokenizer->state.at[0] != '"')
+	char* end = getTokenizerEnd(tokenizer);
+    for (;;)
     {
+		tokenizer->state.at = scanString(tokenizer->state.at, end);
+		if (!tokenizer->state.at[0] || tokenizer->state.at[0] == '"')
+		{
+			break;
+		}
         if((tokenizer->state.at[0] == '\\') &&
             tokenizer->state.at[1])
         {
@@ -106,9 +341,11 @@ internal void eatAllWhitespace(Tokenizer* tokenizer, GetTokenFlags flags)
 {
 	s32 commentBlockDepth = 0;
 	bool eatNewline = !(flags & GET_TOKEN_ACCEPT_NEWLINE);
+	char* end = getTokenizerEnd(tokenizer);
 
     for(;;)
     {
+		tokenizer->state.at = scanWhitespace(tokenizer->state.at, end, eatNewline, &tokenizer->state.lineNumber);
 		if (eatNewline && eatEndOfLine(tokenizer)) {
 			continue;
 		}
@@ -119,7 +356,7 @@ internal void eatAllWhitespace(Tokenizer* tokenizer, GetTokenFlags flags)
         else if((tokenizer->state.at[0] == '/') &&
                 (tokenizer->state.at[1] == '/'))
         {
-            tokenizer->state.at += 2;
+            tokenizer->state.at = scanToEndOfLine(tokenizer->state.at + 2, end);
             while(tokenizer->state.at[0] && !isEndOfLine(tokenizer->state.at[0]))
             {
                 ++tokenizer->state.at;
@@ -133,7 +370,10 @@ internal void eatAllWhitespace(Tokenizer* tokenizer, GetTokenFlags flags)
             tokenizer->state.at += 2;
             while(tokenizer->state.at[0] && commentBlockDepth > 0)
             {
-				if (tokenizer->state.at[0] == '/' && tokenizer->state.at[1] == '*') {
+				tokenizer->state.at = scanBlockComment(tokenizer->state.at, end, &tokenizer->state.lineNumber);
+				if (!tokenizer->state.at[0]) {
+					break;
+				} else if (tokenizer->state.at[0] == '/' && tokenizer->state.at[1] == '*') {
 					++commentBlockDepth;
 					tokenizer->state.at += 2;
 				} else if (tokenizer->state.at[0] == '*' && tokenizer->state.at[1] == '/') {
@@ -151,18 +391,42 @@ internal void eatAllWhitespace(Tokenizer* tokenizer, GetTokenFlags flags)
     }
 }
 
+inline internal TokenizerLookahead* findLookahead(Tokenizer* tokenizer, TokenizerMode mode, GetTokenFlags flags)
+{
+	for (s32 i = 0; i < TOKENIZER_LOOKAHEAD_COUNT; ++i)
+	{
+		TokenizerLookahead* it = &tokenizer->lookahead[i];
+		if (it->at == tokenizer->state.at && it->mode == mode && it->flags == flags)
+		{
+			return it;
+		}
+	}
+	return NULL;
+}
+
+inline internal void addLookahead(Tokenizer* tokenizer, TokenizerState startState, TokenizerMode mode, GetTokenFlags flags, Token token)
+{
+	TokenizerLookahead* it = &tokenizer->lookahead[tokenizer->lookaheadNext];
+	tokenizer->lookaheadNext = (tokenizer->lookaheadNext + 1) % TOKENIZER_LOOKAHEAD_COUNT;
+	it->at = startState.at;
+	it->mode = mode;
+	it->flags = flags;
+	it->token = token;
+	it->endState = tokenizer->state;
+}
+
 inline internal Token initTokenWithTokenizer(Tokenizer* tokenizer)
 {
 	Token token;
 	zeroMemory(&token, sizeof(Token));
     token.length = 1;
-	token.pathName = tokenizer->pathName;
+	token.fileId = tokenizer->fileId;
 	token.lineNumber = tokenizer->state.lineNumber + 1;
     token.data = tokenizer->state.at;
 	return token;
 }
 
-internal Token getToken(Tokenizer* tokenizer, GetTokenFlags flags = GET_TOKEN_NO_FLAGS)
+internal Token lexToken(Tokenizer* tokenizer, GetTokenFlags flags)
 {
 	eatAllWhitespace(tokenizer, flags);
 
@@ -241,15 +505,14 @@ internal Token getToken(Tokenizer* tokenizer, GetTokenFlags flags = GET_TOKEN_NO
             {
                 token.type = TOKEN_IDENTIFIER;
                 
-                while(isAlpha(tokenizer->state.at[0]) ||
-                      isNumber(tokenizer->state.at[0]) ||
-                      (tokenizer->state.at[0] == '_') ||
-					  (tokenizer->state.at[0] == '.'))
+				tokenizer->state.at = scanIdentifier(tokenizer->state.at, getTokenizerEnd(tokenizer), '.');
+                while(isCharClass(tokenizer->state.at[0], CHAR_IDENTIFIER))
                 {
                     ++tokenizer->state.at;
                 }
              
 				token.length = tokenizer->state.at - token.data;
+				token.atom = tokenizer->atoms->intern(token);
             }
             else if(isNumber(C))
             {
@@ -270,16 +533,36 @@ internal Token getToken(Tokenizer* tokenizer, GetTokenFlags flags = GET_TOKEN_NO
             else
             {
                 token.type = TOKEN_UNKNOWN;
-				assert(false);
+				print("Parse error(%d): Unexpected character.\n", token.lineNumber);
+				tokenizerErrorJump(tokenizer);
             }
         } break;        
     }
 
+    return token;
+}
+
+internal Token getToken(Tokenizer* tokenizer, GetTokenFlags flags = GET_TOKEN_NO_FLAGS)
+{
+	Token token;
+	TokenizerLookahead* lookahead = findLookahead(tokenizer, TOKENIZER_MODE_FEL, flags);
+	if (lookahead != NULL)
+	{
+		token = lookahead->token;
+		tokenizer->state = lookahead->endState;
+	}
+	else
+	{
+		TokenizerState startState = tokenizer->state;
+		token = lexToken(tokenizer, flags);
+		addLookahead(tokenizer, startState, TOKENIZER_MODE_FEL, flags, token);
+	}
+
 	// Debugging
 	tokenizer->lastGetToken = tokenizer->currGetToken;
 	tokenizer->currGetToken = token;
 
-    return token;
+	return token;
 }
 
 inline internal Token peekToken(Tokenizer* tokenizer) {
@@ -289,7 +572,7 @@ inline internal Token peekToken(Tokenizer* tokenizer) {
 	return token;
 }
 
-internal Token getTokenCSSProperty(Tokenizer* tokenizer, GetTokenFlags flags = GET_TOKEN_NO_FLAGS)
+internal Token lexTokenCSSProperty(Tokenizer* tokenizer, GetTokenFlags flags)
 {
 	eatAllWhitespace(tokenizer, flags);
 	Token token = initTokenWithTokenizer(tokenizer);
@@ -333,15 +616,14 @@ internal Token getTokenCSSProperty(Tokenizer* tokenizer, GetTokenFlags flags = G
 			{
 				token.type = TOKEN_IDENTIFIER;
                 
-                while(isAlpha(tokenizer->state.at[0]) ||
-                      (tokenizer->state.at[0] == '_') ||
-					  (tokenizer->state.at[0] == '-') ||
-					  (isNumber(tokenizer->state.at[0])))
+				tokenizer->state.at = scanIdentifier(tokenizer->state.at, getTokenizerEnd(tokenizer), '-');
+                while(isCharClass(tokenizer->state.at[0], CHAR_CSS_IDENTIFIER))
                 {
                     ++tokenizer->state.at;
                 }
              
 				token.length = tokenizer->state.at - token.data;
+				token.atom = tokenizer->atoms->intern(token);
 			}
 			else if (C == '#')
 			{
@@ -373,7 +655,8 @@ internal Token getTokenCSSProperty(Tokenizer* tokenizer, GetTokenFlags flags = G
 			else
 			{
 				token.type = TOKEN_UNKNOWN;
-				assert(false);
+				print("Parse error(%d): Unexpected character.\n", token.lineNumber);
+				tokenizerErrorJump(tokenizer);
 			}
 		}
 		break;
@@ -381,6 +664,20 @@ internal Token getTokenCSSProperty(Tokenizer* tokenizer, GetTokenFlags flags = G
 	return token;
 }
 
+internal Token getTokenCSSProperty(Tokenizer* tokenizer, GetTokenFlags flags = GET_TOKEN_NO_FLAGS)
+{
+	TokenizerLookahead* lookahead = findLookahead(tokenizer, TOKENIZER_MODE_CSS_PROPERTY, flags);
+	if (lookahead != NULL)
+	{
+		tokenizer->state = lookahead->endState;
+		return lookahead->token;
+	}
+	TokenizerState startState = tokenizer->state;
+	Token token = lexTokenCSSProperty(tokenizer, flags);
+	addLookahead(tokenizer, startState, TOKENIZER_MODE_CSS_PROPERTY, flags, token);
+	return token;
+}
+
 inline internal Token peekTokenCSSProperty(Tokenizer* tokenizer) {
 	TokenizerState prevState = tokenizer->state;
 	Token token = getTokenCSSProperty(tokenizer);
@@ -424,7 +721,8 @@ inline internal Token peekTokenCSSProperty(Tokenizer* tokenizer) {
 			else
 			{
 				token.type = TOKEN_UNKNOWN;
-				assert(false);
+				print("Parse error(%d): Unexpected character.\n", token.lineNumber);
+				tokenizerErrorJump(tokenizer);
 			}
 		}
 		break;
@@ -8,32 +8,257 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Keep the console window open when run from Visual Studio
+inline void waitForExit()
+{
+#if defined(_WIN32)
+	while(true) {}
+#endif
+}
+
+// Compiles with errors jumping back here rather than asserting, so a mistake in a file
+// being watched is reported and can be fixed on the next save.
+internal void compileRecoverable(Compiler* compiler)
+{
+	jmp_buf errorJump;
+	compiler->errorJump = &errorJump;
+	if (setjmp(errorJump) == 0)
+	{
+		compile(compiler);
+	}
+	compiler->errorJump = NULL;
+}
+
+// Keeps the parsed files resident and recompiles whenever a file under the target directory
+// changes. Only the changed files are parsed again, each into its own arena, and the dependency
+// graph from the previous compile limits recompiling to the layouts that used them.
+internal void watchForChanges(Compiler* compiler)
+{
+	Directory::Watcher* watcher = Directory::watch(compiler->targetDirectory, compiler->pool);
+	if (watcher == NULL)
+	{
+		print("Unable to watch directory: %s\n", &compiler->targetDirectory);
+		return;
+	}
+
+	AllocatorPool* previousCompilePool = NULL;
+	for (;;)
+	{
+		print("\nWatching %s for changes...\n", &compiler->targetDirectory);
+		TemporaryPoolScope tempPool(compiler->poolTransient);
+		Directory::Error error = {};
+		StringLinkedList changes = Directory::waitForChanges(watcher, tempPool._allocator, &error);
+		if (error.errorCode != Directory::DIRECTORY_NO_ERROR)
+		{
+			print("Stopped watching, unable to wait for changes in %s\n", &compiler->targetDirectory);
+			break;
+		}
+
+		bool hasChanges = false;
+		for (StringLinkedListNode* node = changes.first; node != NULL; node = node->next)
+		{
+			String pathname = node->string;
+			if (!pathname.fileExtension().cmp("fel"))
+			{
+				continue;
+			}
+			s32 index = -1;
+			for (s32 i = 0; i < compiler->astFiles->used; ++i)
+			{
+				if (compiler->astFiles->data[i].pathname.cmp(pathname))
+				{
+					index = i;
+					break;
+				}
+			}
+			if (index != -1)
+			{
+				pathname = compiler->astFiles->data[index].pathname;
+			}
+			else
+			{
+				// NOTE: The AST and dependency graph reference the pathname, so it must outlive the changes.
+				String newPathname = {};
+				newPathname.length = pathname.length;
+				newPathname.data = (char*)pushSizeUninitialized(pathname.length + 1, compiler->pool);
+				memcpy(newPathname.data, pathname.data, pathname.length);
+				newPathname.data[newPathname.length] = '\0';
+				pathname = newPathname;
+			}
+
+			u16 fileId;
+			if (!getFileId(compiler, pathname, &fileId))
+			{
+				continue;
+			}
+			AllocatorPool* filePool = AllocatorPool::createFromOS(Kilobytes(256));
+			AST_File ast_file;
+			bool hasParseError = false;
+			bool isValid = parseFile(&ast_file, pathname, fileId, compiler->atoms, compiler->cacheDirectory, filePool, compiler->poolTransient, &hasParseError);
+			if (!isValid)
+			{
+				filePool->free();
+			}
+			if (hasParseError)
+			{
+				// Keep the last version that parsed until it's fixed
+				print("Unable to parse %s, keeping the previous version.\n", &pathname);
+				continue;
+			}
+			if (isValid)
+			{
+				ast_file.pool = filePool;
+			}
+			if (isValid && index != -1 && ast_file.contentHash == compiler->astFiles->data[index].contentHash)
+			{
+				// Saved without changes
+				freeASTFile(&ast_file);
+				continue;
+			}
+
+			// NOTE: Atoms and dependency graph names are copied, so nothing points into the old AST once it's replaced.
+			if (index != -1)
+			{
+				freeASTFile(&compiler->astFiles->data[index]);
+			}
+			if (isValid)
+			{
+				if (index != -1)
+				{
+					compiler->astFiles->data[index] = ast_file;
+				}
+				else
+				{
+					if (compiler->astFiles->used == compiler->astFiles->size)
+					{
+						compiler->astFiles->resize(compiler->astFiles->size * 2);
+					}
+					compiler->astFiles->push(ast_file);
+				}
+			}
+			else
+			{
+				// Deleted or emptied
+				if (index != -1)
+				{
+					AST_File* files = compiler->astFiles->data;
+					memmove(&files[index], &files[index + 1], (compiler->astFiles->used - index - 1) * sizeof(AST_File));
+					--compiler->astFiles->used;
+				}
+			}
+			hasChanges = true;
+		}
+		if (!hasChanges)
+		{
+			continue;
+		}
+
+		// NOTE: Each compile gets its own arena, the previous one is kept until this one
+		//		 succeeds as the dependency graph lives in it.
+		AllocatorPool* compilePool = AllocatorPool::createFromOS(Megabytes(4));
+		Compiler run = *compiler;
+		run.hasError = false;
+		run.pool = compilePool;
+		run.poolTransient = compilePool->create(Megabytes(1));
+		run.stack = Array<CompilerParameters*>::create(256, compilePool);
+		run.componentsUsed = Array<AST_ComponentDefinition*>::create(256, compilePool);
+		compileRecoverable(&run);
+		if (run.hasError)
+		{
+			printf("Fatal error compiling.\n");
+			compilePool->free();
+			continue;
+		}
+		compiler->dependencies = run.dependencies;
+		if (previousCompilePool != NULL)
+		{
+			previousCompilePool->free();
+		}
+		previousCompilePool = compilePool;
+		printf("Finished compiling successfully.\n");
+	}
+}
+
 int main(int argc, char** argv){
 	// Initialize compiler
 	Compiler compiler;
 	zeroMemory(&compiler, sizeof(compiler));
-	compiler.pool =  AllocatorPool::createFromOS(Megabytes(24));
-	compiler.poolTransient = compiler.pool->create(Megabytes(8));
+	compiler.pool =  AllocatorPool::createFromOS(Megabytes(4));
+	compiler.poolTransient = compiler.pool->create(Megabytes(1));
 	compiler.astFiles = Array<AST_File>::create(1024, compiler.pool);
+	compiler.filePathnames = Array<String>::create(1024, compiler.pool);
+	compiler.fileIds = HashTable<u16>::create(1024, compiler.pool);
+	compiler.atoms = AtomTable::create(AllocatorPool::createFromOS(Megabytes(1)));
 	compiler.stack = Array<CompilerParameters*>::create(256, compiler.pool);
+	compiler.expressionStack = pushArrayStruct(CompilerValue, AST_PROGRAM_MAX_STACK_SIZE, compiler.pool);
 	compiler.componentsUsed = Array<AST_ComponentDefinition*>::create(256, compiler.pool);
 
+	// Get command line arguments
+	// ie. fel /var/www/wp-content/themes/twentysixteen/fel/ --cache /tmp/fel-cache --watch --output /tmp/theme
+	for (s32 i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+		{
+			compiler.cacheDirectory = String::create(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--watch") == 0)
+		{
+			compiler.isWatching = true;
+		}
+		else if (strcmp(argv[i], "--write") == 0)
+		{
+			compiler.isWritingOutput = true;
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+		{
+			compiler.outputDirectory = String::create(argv[++i]);
+			compiler.isWritingOutput = true;
+		}
+		else
+		{
+			compiler.targetDirectory = String::create(argv[i]);
+		}
+	}
+	if (compiler.cacheDirectory.length >= Kilobytes(1))
+	{
+		print("Cache directory path is too long, not caching.\n");
+		compiler.cacheDirectory.length = 0;
+	}
+	else if (compiler.cacheDirectory.length > 0 && !Directory::create(compiler.cacheDirectory))
+	{
+		print("Unable to create cache directory: %s\n", &compiler.cacheDirectory);
+		compiler.cacheDirectory.length = 0;
+	}
+
 	// Get all files in directory
-	compiler.targetDirectory = String::create("C:\\wamp\\www\\nweb\\test\\wordpress\\wp-content\\themes\\twentysixteen\\fel\\");
-	StringLinkedList files = Directory::getFilesRecursive(compiler.pool, compiler.targetDirectory);
-	if (files.first == NULL)
+	StringLinkedList files = {};
+	if (compiler.targetDirectory.length > 0)
+	{
+		files = Directory::getFilesRecursive(compiler.pool, compiler.targetDirectory);
+		if (files.first == NULL)
+		{
+			printf("Invalid directory supplied. Terminating program.\n");
+			return -1;
+		}
+	}
+	else
 	{
-		compiler.targetDirectory = String::create("D:\\wamp\\www\\Nweb\\test\\wordpress\\wp-content\\themes\\twentysixteen\\fel\\");
+		compiler.targetDirectory = String::create("C:\\wamp\\www\\nweb\\test\\wordpress\\wp-content\\themes\\twentysixteen\\fel\\");
 		files = Directory::getFilesRecursive(compiler.pool, compiler.targetDirectory);
 		if (files.first == NULL)
-		{	
-			compiler.targetDirectory = String::create("C:\\wamp\\www\\PersonalProjects\\fel\\test\\wordpress\\wp-content\\themes\\twentysixteen\\fel\\");
+		{
+			compiler.targetDirectory = String::create("D:\\wamp\\www\\Nweb\\test\\wordpress\\wp-content\\themes\\twentysixteen\\fel\\");
 			files = Directory::getFilesRecursive(compiler.pool, compiler.targetDirectory);
 			if (files.first == NULL)
 			{	
-				printf("Invalid directory supplied. Terminating program.\n");
-				while(true) {}
-				return -1;
+				compiler.targetDirectory = String::create("C:\\wamp\\www\\PersonalProjects\\fel\\test\\wordpress\\wp-content\\themes\\twentysixteen\\fel\\");
+				files = Directory::getFilesRecursive(compiler.pool, compiler.targetDirectory);
+				if (files.first == NULL)
+				{	
+					printf("Invalid directory supplied. Terminating program.\n");
+					waitForExit();
+					return -1;
+				}
 			}
 		}
 	}
@@ -41,7 +266,7 @@ int main(int argc, char** argv){
 	if (compiler.targetDirectory.length == 0) 
 	{
 		printf("No directory supplied. Terminating program.\n");
-		while(true) {}
+		waitForExit();
 		return -1;
 	}
 
@@ -51,29 +276,48 @@ int main(int argc, char** argv){
 		compiler.outputDirectory = compiler.targetDirectory.goUpDirectory();
 	}
 	assert(compiler.outputDirectory.length != 0);
+	char lastCharacter = compiler.outputDirectory.data[compiler.outputDirectory.length - 1];
+	if (lastCharacter != '/' && lastCharacter != '\\')
+	{
+		TemporaryPoolScope tempPool(compiler.poolTransient);
+		StringBuilder builder(10, tempPool);
+		builder.add(compiler.outputDirectory);
+		builder.add("/");
+		compiler.outputDirectory = builder.toString(compiler.pool);
+	}
 
 	// Parse each file and add the AST to the compilers files
-	for (StringLinkedListNode* node = files.first; node != NULL; node = node->next)
+	parseFiles(&compiler, files);
+	if (compiler.hasError)
 	{
-		// Only parse files with the '.fel' extension
-		if (node->string.fileExtension().cmp("fel"))
-		{
-			parse(&compiler, node->string);
-		}
+		printf("Fatal error parsing.\n");
+		waitForExit();
+		return -1;
 	}
 	printf("Finished parsing.\n");
 
 	// Run compile
-	compile(&compiler);
+	if (compiler.isWatching)
+	{
+		compileRecoverable(&compiler);
+	}
+	else
+	{
+		compile(&compiler);
+	}
 	if (compiler.hasError)
 	{
 		printf("Fatal error compiling.\n");
 	}
 	else
 	{
-		print("Finished compiling successfully. Memory Used: %d, Transient Memory Used: %d (should be 0).\n", compiler.pool->used - compiler.poolTransient->size, compiler.poolTransient->used);
+		print("Finished compiling successfully. Memory Used: %d (peak %d), Transient Memory Used: %d (should be 0, peak %d).\n", (s32)(compiler.pool->getUsed() - compiler.poolTransient->chunkSize), (s32)(compiler.pool->highWaterMark - compiler.poolTransient->chunkSize), (s32)compiler.poolTransient->getUsed(), (s32)compiler.poolTransient->highWaterMark);
 	}
-	while(true) {}
+	if (compiler.isWatching)
+	{
+		watchForChanges(&compiler);
+	}
+	waitForExit();
 	return 0;
 }
 
@@ -14,14 +14,23 @@ enum AllocatorTypes {
 };
 
 inline void zeroMemory(void* src, memory_index size) {
-	u8 *byte = (u8*)src;
-    while(size--)
-    {
-        *byte++ = 0;
-    }
+	// NOTE: memset clears a word/vector at a time rather than byte-by-byte
+	memset(src, 0, size);
 }
 
+// NOTE: A block of memory an AllocatorPool allocates from. Pools start with a single chunk and
+//		 chain more onto it as they run out, so nothing has to be sized up front.
+struct AllocatorChunk {
+	AllocatorChunk* prev;
+	void* base;
+	memory_index size;
+	memory_index used; // Only up-to-date when this isn't the pools current chunk
+	memory_index dirty; // Everything past this offset has never been handed out and is still zero
+	bool isFromOS;
+};
+
 struct Allocator {
+	// NOTE: These mirror the current chunk
 	void* base;
 	memory_index size;
 	memory_index used;
@@ -29,32 +38,43 @@ struct Allocator {
 
 struct AllocatorPool : Allocator {
 	s32 tempCount;
+	AllocatorChunk* chunk;
+	AllocatorChunk* freeChunks; // Chunks released by TemporaryPool::end(), kept to be reused
+	memory_index chunkSize; // Minimum size of each new chunk
+	memory_index usedInPreviousChunks;
+	memory_index highWaterMark;
+	s32 chunkCount;
+
 	inline static AllocatorPool* createFromOS(memory_index size);
 	inline AllocatorPool* create(memory_index size);
 	// NOTE(Jake): Once freed, do not make any calls/stop using the Allocator as it will
 	//			   no longer exist.
 	inline void free();
+	inline memory_index getUsed() { return usedInPreviousChunks + used; }
+	inline void grow(memory_index minimumSize);
+	inline void resetTo(AllocatorChunk* markChunk, memory_index markUsed);
 };
 
 struct TemporaryPool
 {
     AllocatorPool* _allocator;
+    AllocatorChunk* chunk;
     memory_index used;
 
 	inline void begin(AllocatorPool* allocator)
 	{
 		assert(allocator != NULL);
-		assert(allocator->size == 8388608); // NOTE(Jake): Put in place to detect when I used the wrong pool to fix.
-		zeroMemory(this, sizeof(this));
+		zeroMemory(this, sizeof(*this));
 		this->_allocator = allocator;
+		this->chunk = allocator->chunk;
 		this->used = allocator->used;
 		++allocator->tempCount;
 	}
 
 	inline void end()
 	{
-		assert(_allocator->used >= used);
-		_allocator->used = used;
+		assert(_allocator->chunk != chunk || _allocator->used >= used);
+		_allocator->resetTo(chunk, used);
 		assert(_allocator->tempCount > 0);
 		--_allocator->tempCount;
 	}
@@ -84,40 +104,82 @@ inline internal memory_index getAlignmentOffset(memory_index base, memory_index
     return(alignmentOffset);
 }
 
-inline void* pushSize_(AllocatorPool* allocator, memory_index sizeInit) {
+inline void* pushSize_(AllocatorPool* allocator, memory_index sizeInit, bool clearToZero = true) {
 	assert(allocator != NULL);
 	memory_index size = sizeInit;
 	memory_index alignmentOffset = getAlignmentOffset((memory_index)allocator->base, allocator->used, MEMORY_DEFAULT_ALIGNMENT);
     size += alignmentOffset;
     
+    if ((allocator->used + size) > allocator->size)
+    {
+        allocator->grow(sizeInit);
+        alignmentOffset = getAlignmentOffset((memory_index)allocator->base, allocator->used, MEMORY_DEFAULT_ALIGNMENT);
+        size = sizeInit + alignmentOffset;
+    }
     assert((allocator->used + size) <= allocator->size);
     void* result = (char *)allocator->base + allocator->used + alignmentOffset;
-    zeroMemory(result, size);
-    allocator->used += size;
+    memory_index end = allocator->used + size;
+    AllocatorChunk* chunk = allocator->chunk;
+    if (clearToZero && allocator->used < chunk->dirty)
+    {
+        // Only memory that's been handed out before (and since reset by a TemporaryPool) needs clearing
+        memory_index dirtyEnd = (end < chunk->dirty) ? end : chunk->dirty;
+        zeroMemory((char *)allocator->base + allocator->used, dirtyEnd - allocator->used);
+    }
+    if (end > chunk->dirty)
+    {
+        chunk->dirty = end;
+    }
+    allocator->used = end;
+    if (allocator->getUsed() > allocator->highWaterMark)
+    {
+        allocator->highWaterMark = allocator->getUsed();
+    }
 
     assert(size >= sizeInit);
     
     return(result);
 }
 
-inline void* pushSize_(TemporaryPool temp, memory_index sizeInit) {
-	return pushSize_(temp._allocator, sizeInit);
+inline void* pushSize_(TemporaryPool temp, memory_index sizeInit, bool clearToZero = true) {
+	return pushSize_(temp._allocator, sizeInit, clearToZero);
 }
 
 #define pushSize(size, allocator, ...) pushSize_(allocator, size, ## __VA_ARGS__)
 #define pushStruct(type, allocator, ...) (type *)pushSize_(allocator, sizeof(type), ## __VA_ARGS__)
 #define pushArrayStruct(type, size, allocator, ...) (type *)pushSize_(allocator, sizeof(type) * size, ## __VA_ARGS__)
+// NOTE: Skips clearing the memory, only use when everything is written before it's read.
+#define pushSizeUninitialized(size, allocator) pushSize_(allocator, size, false)
+#define pushArrayStructUninitialized(type, size, allocator) (type *)pushSize_(allocator, sizeof(type) * size, false)
 
 #define pushSizeCurrent(size, ...) pushSize(size, g_allocator, ## __VA_ARGS__)
 #define pushStructCurrent(type, ...) pushStruct(type, g_allocator, ## __VA_ARGS__)
 #define pushArrayStructCurrent(type, size, ...) pushArrayStruct(type, size, g_allocator, ## __VA_ARGS__)
 
+inline internal AllocatorChunk* createChunkFromOS(memory_index size)
+{
+	// NOTE: The chunk header sits at the front of its own block
+	// NOTE: calloc() gets fresh pages from the OS already zeroed, so pushSize_ never has to clear them.
+	AllocatorChunk* chunk = (AllocatorChunk*)calloc(1, sizeof(AllocatorChunk) + size);
+	assert(chunk != NULL);
+	chunk->prev = NULL;
+	chunk->base = chunk + 1;
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->dirty = 0;
+	chunk->isFromOS = true;
+	return chunk;
+}
+
 AllocatorPool* AllocatorPool::createFromOS(memory_index size) 
 {
 	AllocatorPool stackPool;
 	zeroMemory(&stackPool, sizeof(stackPool));
-	stackPool.base = malloc(size);
+	stackPool.chunk = createChunkFromOS(size);
+	stackPool.base = stackPool.chunk->base;
 	stackPool.size = size;
+	stackPool.chunkSize = size;
+	stackPool.chunkCount = 1;
 
 	AllocatorPool* pool = pushStruct(AllocatorPool, &stackPool);
 	*pool = stackPool;
@@ -127,15 +189,84 @@ AllocatorPool* AllocatorPool::createFromOS(memory_index size)
 AllocatorPool* AllocatorPool::create(memory_index size)
 {
 	AllocatorPool* pool = pushStruct(AllocatorPool, this);
-	pool->base = pushSize(size, this);
+	pool->chunk = pushStruct(AllocatorChunk, this);
+	pool->chunk->base = pushSize(size, this);
+	pool->chunk->size = size;
+	pool->base = pool->chunk->base;
 	pool->size = size;
+	pool->chunkSize = size;
+	pool->chunkCount = 1;
 	return pool;
 }
 
+void AllocatorPool::grow(memory_index minimumSize)
+{
+	// Leave room to align the allocation within the new chunk
+	minimumSize += MEMORY_DEFAULT_ALIGNMENT;
+
+	chunk->used = used;
+	usedInPreviousChunks += used;
+
+	// Reuse a chunk that a TemporaryPool released if there's one big enough
+	AllocatorChunk* newChunk = NULL;
+	for (AllocatorChunk** it = &freeChunks; *it != NULL; it = &(*it)->prev)
+	{
+		if ((*it)->size >= minimumSize)
+		{
+			newChunk = *it;
+			*it = newChunk->prev;
+			break;
+		}
+	}
+	if (newChunk == NULL)
+	{
+		newChunk = createChunkFromOS(minimumSize > chunkSize ? minimumSize : chunkSize);
+		++chunkCount;
+	}
+	newChunk->prev = chunk;
+	newChunk->used = 0;
+
+	chunk = newChunk;
+	base = newChunk->base;
+	size = newChunk->size;
+	used = 0;
+}
+
+void AllocatorPool::resetTo(AllocatorChunk* markChunk, memory_index markUsed)
+{
+	while (chunk != markChunk)
+	{
+		assert(chunk != NULL);
+		AllocatorChunk* releasedChunk = chunk;
+		chunk = releasedChunk->prev;
+		usedInPreviousChunks -= chunk->used;
+
+		releasedChunk->prev = freeChunks;
+		freeChunks = releasedChunk;
+	}
+	base = chunk->base;
+	size = chunk->size;
+	used = markUsed;
+}
+
 void AllocatorPool::free() 
 {
 	assert(tempCount == 0);
-	::free(base);
+	// NOTE: The pool itself may live in its first chunk, so read everything before freeing.
+	AllocatorChunk* lists[2] = { freeChunks, chunk };
+	for (s32 i = 0; i < 2; ++i)
+	{
+		AllocatorChunk* it = lists[i];
+		while (it != NULL)
+		{
+			AllocatorChunk* prev = it->prev;
+			if (it->isFromOS)
+			{
+				::free(it);
+			}
+			it = prev;
+		}
+	}
 }
 
 #endif
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include "array.h"
 #include "ast.h"
 #include "ast_print.h"
+#include "ast_cache.h"
+#include "thread.h"
 
 enum Parameter_ReadMode {
 	PARAMETER_MODE_UNKNOWN = 0,
@@ -24,8 +26,8 @@ enum ParserMode {
 	PARSER_MODE_STATEMENT, // ie. variable = token1 + token2
 };
 
-#define parseError(token, format, ...) print("Parse error(%d,%d): "format"\n", token.lineNumber, __LINE__, ## __VA_ARGS__); assert(false)
-AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode);
+#define parseError(token, format, ...) print("Parse error(%d,%d): " format "\n", token.lineNumber, __LINE__, ## __VA_ARGS__); tokenizerErrorJump(tokenizer)
+internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode);
 
 inline bool isEndOfVariableList(Token token, ParserMode mode)
 {
@@ -81,9 +83,11 @@ internal AST_Parameters* parseVariableList(Tokenizer* tokenizer, ParserMode mode
 		tokenizer->state = prevState;
 	}
 
+	// NOTE: Collect into scratch arrays, then copy exactly what was used onto the permanent pool.
+	TemporaryPoolScope tempPool(tokenizer->poolTransient);
 	#define MAX_VARLIST_COUNT 32
-	Array<Token>* names = Array<Token>::create(MAX_VARLIST_COUNT, tokenizer->pool);
-	Array<AST_Expression*>* values = Array<AST_Expression*>::create(MAX_VARLIST_COUNT, tokenizer->pool);
+	Array<Token> names(MAX_VARLIST_COUNT, tempPool);
+	Array<AST_Expression*> values(MAX_VARLIST_COUNT, tempPool);
 	#undef MAX_VARLIST_COUNT
 	
 	AST_Parameters* ast = pushStruct(AST_Parameters, tokenizer->pool);
@@ -125,17 +129,17 @@ internal AST_Parameters* parseVariableList(Tokenizer* tokenizer, ParserMode mode
 		assert(expression != NULL);
 		expression->parent = ast;
 
-		if (values->used == values->size)
+		if (values.used == values.size)
 		{
-			parseError(name, "Maximum allowed parameters for function or component is %d.", values->size);
+			parseError(name, "Maximum allowed parameters for function or component is %d.", values.size);
 			return NULL;
 		}
 
 		if (readingMode == PARAMETER_MODE_NAMED) 
 		{
-			names->push(name);
+			names.push(name);
 		}
-		values->push(expression);
+		values.push(expression);
 
 		// If found end of variable list
 		// ie. parameters ends with ')', eg. my_div(class = "wow")
@@ -154,10 +158,8 @@ internal AST_Parameters* parseVariableList(Tokenizer* tokenizer, ParserMode mode
 		}
 	}
 
-	assert(values != NULL);
-
-	ast->names = names;
-	ast->values = values;
+	ast->names = names.createCopyExactSize(tokenizer->pool);
+	ast->values = values.createCopyExactSize(tokenizer->pool);
 
 	assert(ast->names != NULL);
 	assert(ast->values != NULL);
@@ -183,11 +185,229 @@ inline bool isEndOfExpression(Token token, ParserMode mode) {
 	return false;
 }
 
+//
+// Expression lowering
+//
+struct LowerNode {
+	AST_Opcode opcode;
+	s32 tokenIndex;
+	AST_Constant constant; // Set for AST_OPCODE_CONSTANT
+	LowerNode* left;
+	LowerNode* right;
+};
+
+inline AST_Opcode getOperatorOpcode(TokenType type)
+{
+	switch (type)
+	{
+		case TOKEN_PLUS: return AST_OPCODE_ADD;
+		case TOKEN_MULTIPLY: return AST_OPCODE_MULTIPLY;
+		case TOKEN_COND_AND: return AST_OPCODE_COND_AND;
+		case TOKEN_COND_OR: return AST_OPCODE_COND_OR;
+		case TOKEN_COND_EQUAL: return AST_OPCODE_COND_EQUAL;
+		default: break;
+	}
+	return AST_OPCODE_UNKNOWN;
+}
+
+// Applies an operator to two literals the same way the compiler would. Returns false for anything the
+// compiler reports as an error (ie. adding a string and number) so it's still reported when compiled.
+internal bool foldConstants(AST_Opcode opcode, AST_Constant* lval, AST_Constant* rval, AST_Constant* result, AllocatorPool* pool)
+{
+	zeroMemory(result, sizeof(*result));
+	if (lval->isString && rval->isString)
+	{
+		if (opcode == AST_OPCODE_ADD)
+		{
+			String* str = &result->valueString;
+			result->isString = true;
+			str->length = lval->valueString.length + rval->valueString.length;
+			str->data = (char*)pushSizeUninitialized(str->length + 1, pool);
+			memcpy(str->data, lval->valueString.data, lval->valueString.length);
+			memcpy(str->data + lval->valueString.length, rval->valueString.data, rval->valueString.length);
+			return true;
+		}
+		else if (opcode == AST_OPCODE_COND_EQUAL)
+		{
+			result->valueDouble = lval->valueString.cmp(rval->valueString);
+			return true;
+		}
+	}
+	else if (!lval->isString && !rval->isString)
+	{
+		f64 lreal = lval->valueDouble;
+		f64 rreal = rval->valueDouble;
+		switch (opcode)
+		{
+			case AST_OPCODE_ADD: result->valueDouble = lreal + rreal; return true;
+			case AST_OPCODE_MULTIPLY: result->valueDouble = lreal * rreal; return true;
+			case AST_OPCODE_COND_AND: result->valueDouble = lreal && rreal; return true;
+			case AST_OPCODE_COND_OR: result->valueDouble = lreal || rreal; return true;
+			default: break;
+		}
+	}
+	return false;
+}
+
+internal void emitLowerNode(LowerNode* node, s32 depth, AST_Program* program, Array<AST_Instruction>* instructions, Array<AST_Constant>* constants, AllocatorPool* pool)
+{
+	if (depth + 1 > program->stackSize)
+	{
+		program->stackSize = depth + 1;
+	}
+
+	AST_Instruction instruction;
+	zeroMemory(&instruction, sizeof(instruction));
+	instruction.opcode = (u8)node->opcode;
+	instruction.operand = (u16)node->tokenIndex;
+	switch (node->opcode)
+	{
+		case AST_OPCODE_CONSTANT:
+		{
+			instruction.operand = (u16)constants->used;
+			constants->push(node->constant);
+		}
+		break;
+
+		case AST_OPCODE_IDENTIFIER:
+			// no-op
+		break;
+
+		case AST_OPCODE_ADD:
+		{
+			// Flatten 'a + b + c' into one instruction so strings are joined with one allocation.
+			LowerNode* operands[AST_PROGRAM_MAX_STACK_SIZE];
+			s32 operandCount = 0;
+			LowerNode* at = node;
+			while (at->opcode == AST_OPCODE_ADD)
+			{
+				operands[operandCount++] = at->right;
+				at = at->left;
+			}
+			operands[operandCount++] = at;
+			for (s32 i = 0; i < operandCount / 2; ++i)
+			{
+				LowerNode* swap = operands[i];
+				operands[i] = operands[operandCount - 1 - i];
+				operands[operandCount - 1 - i] = swap;
+			}
+
+			// Join neighbouring literal strings, ie. 'title + "-" + "page"'
+			s32 count = 1;
+			for (s32 i = 1; i < operandCount; ++i)
+			{
+				LowerNode* prev = operands[count - 1];
+				LowerNode* it = operands[i];
+				if (prev->opcode == AST_OPCODE_CONSTANT && prev->constant.isString
+					&& it->opcode == AST_OPCODE_CONSTANT && it->constant.isString)
+				{
+					AST_Constant joined;
+					foldConstants(AST_OPCODE_ADD, &prev->constant, &it->constant, &joined, pool);
+					prev->constant = joined;
+				}
+				else
+				{
+					operands[count++] = it;
+				}
+			}
+
+			for (s32 i = 0; i < count; ++i)
+			{
+				emitLowerNode(operands[i], depth + i, program, instructions, constants, pool);
+			}
+			if (count == 1)
+			{
+				return;
+			}
+			assert(count <= 255);
+			instruction.count = (u8)count;
+		}
+		break;
+
+		default:
+		{
+			emitLowerNode(node->left, depth, program, instructions, constants, pool);
+			emitLowerNode(node->right, depth + 1, program, instructions, constants, pool);
+			instruction.count = 2;
+		}
+		break;
+	}
+	instructions->push(instruction);
+}
+
+// Lowers the postfix tokens of an expression into an AST_Program. Returns NULL if the expression
+// can only be evaluated token by token (ie. it uses backend identifiers/functions) or is malformed,
+// which is left for the compiler to report.
+internal AST_Program* lowerExpression(Tokenizer* tokenizer, Array<AST_Expression_Token>* tokens)
+{
+	if (tokens->used == 0 || tokens->used >= AST_PROGRAM_MAX_STACK_SIZE)
+	{
+		return NULL;
+	}
+
+	TemporaryPoolScope tempPool(tokenizer->poolTransient);
+	Array<LowerNode*> stack(tokens->used, tempPool);
+	for (s32 i = 0; i < tokens->used; ++i)
+	{
+		AST_Expression_Token* it = &tokens->data[i];
+		Token token = it->name;
+		LowerNode* node = pushStruct(LowerNode, tempPool._allocator);
+		node->tokenIndex = i;
+		if (token.type == TOKEN_STRING)
+		{
+			node->opcode = AST_OPCODE_CONSTANT;
+			node->constant.isString = true;
+			node->constant.valueString = token;
+		}
+		else if (token.type == TOKEN_NUMBER)
+		{
+			node->opcode = AST_OPCODE_CONSTANT;
+			node->constant.valueDouble = token.toDouble();
+		}
+		else if (token.type == TOKEN_IDENTIFIER)
+		{
+			if (token.isBackend() || it->isFunction)
+			{
+				return NULL;
+			}
+			node->opcode = AST_OPCODE_IDENTIFIER;
+		}
+		else
+		{
+			node->opcode = getOperatorOpcode(token.type);
+			if (node->opcode == AST_OPCODE_UNKNOWN || stack.used < 2)
+			{
+				return NULL;
+			}
+			node->right = stack.pop();
+			node->left = stack.pop();
+			if (node->left->opcode == AST_OPCODE_CONSTANT && node->right->opcode == AST_OPCODE_CONSTANT
+				&& foldConstants(node->opcode, &node->left->constant, &node->right->constant, &node->constant, tokenizer->pool))
+			{
+				node->opcode = AST_OPCODE_CONSTANT;
+			}
+		}
+		stack.push(node);
+	}
+	if (stack.used != 1)
+	{
+		return NULL;
+	}
+
+	Array<AST_Instruction> instructions(tokens->used, tempPool);
+	Array<AST_Constant> constants(tokens->used, tempPool);
+	AST_Program* program = pushStruct(AST_Program, tokenizer->pool);
+	emitLowerNode(stack.top(), 0, program, &instructions, &constants, tokenizer->pool);
+	program->instructions = instructions.createCopyExactSize(tokenizer->pool);
+	program->constants = constants.createCopyExactSize(tokenizer->pool);
+	return program;
+}
+
 internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode) {
 	TemporaryPoolScope tempPool(tokenizer->poolTransient);
 	Array<AST_Expression_Token> operatorTokens = Array<AST_Expression_Token>(255, tempPool);
 
-	Array<AST_Expression_Token>* exprTokens = Array<AST_Expression_Token>::create(255, tokenizer->pool);
+	Array<AST_Expression_Token> exprTokens = Array<AST_Expression_Token>(255, tempPool);
 	
 	AST_Expression* ast = pushAST(AST_Expression, AST_EXPRESSION, tokenizer->pool);
 	s32 parenOpenCount = 0;
@@ -244,7 +464,7 @@ internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode)
 					op.name = getToken(tokenizer); // skip closing paren ')'
 				}
 			}
-			exprTokens->push(fullToken);
+			exprTokens.push(fullToken);
 
 			/*if (isEndOfExpression(op.token, mode) || op.token.type == TOKEN_PAREN_CLOSE)
 			{
@@ -259,7 +479,7 @@ internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode)
 		}
 		else if (token.type == TOKEN_NUMBER)
 		{
-			exprTokens->push(fullToken);
+			exprTokens.push(fullToken);
 		}
 		else if (token.isOperator())
 		{
@@ -270,7 +490,7 @@ internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode)
 				AST_Expression_Token topOperator = operatorTokens.top();
 				if (topOperator.name.getPrecedence() >= token.getPrecedence())
 				{
-					exprTokens->push(operatorTokens.pop());
+					exprTokens.push(operatorTokens.pop());
 				}
 				else
 				{
@@ -281,7 +501,7 @@ internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode)
 		}
 		else if (token.type == TOKEN_STRING)
 		{
-			exprTokens->push(fullToken);
+			exprTokens.push(fullToken);
 		}
 		else if (token.type == TOKEN_PAREN_OPEN)
 		{
@@ -307,7 +527,7 @@ internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode)
 			AST_Expression_Token topOperator = operatorTokens.pop();
 			if (topOperator.name.type != TOKEN_PAREN_OPEN)
 			{
-				exprTokens->push(topOperator);
+				exprTokens.push(topOperator);
 				operatorTokens.pop(); // NOTE(Jake): copy pasted from PHP, can't recall why this is done.
 			}
 			++parenCloseCount;
@@ -346,16 +566,15 @@ internal AST_Expression* parseExpression(Tokenizer* tokenizer, ParserMode mode)
 
 	while (operatorTokens.used > 0)
 	{
-		exprTokens->push(operatorTokens.pop());
+		exprTokens.push(operatorTokens.pop());
 	}
 
-	assert(exprTokens != NULL || exprTokens->used != 0);
-
 	if (parenOpenCount != parenCloseCount)
 	{
-		parseError(exprTokens->data[0].name, "Mismatching parenthesis on expression.");
+		parseError(exprTokens.data[0].name, "Mismatching parenthesis on expression.");
 	}
-	ast->tokens = exprTokens;
+	ast->tokens = exprTokens.createCopyExactSize(tokenizer->pool);
+	ast->program = lowerExpression(tokenizer, ast->tokens);
 	return ast;
 }
 
@@ -369,17 +588,17 @@ internal AST_Expression_Block* parseExpressionBlock(Tokenizer* tokenizer) {
 	}
 	AST_Expression_Block* ast = pushAST(AST_Expression_Block, AST_UNKNOWN, tokenizer->pool);
 	expr->parent = ast;
-	if (keywordName.cmp("if"))
+	if (keywordName.atom == ATOM_IF)
 	{
 		ast->type = AST_IF;
 	}
-	else if (keywordName.cmp("loop"))
+	else if (keywordName.atom == ATOM_LOOP)
 	{
 		// 'loop' keyword brings all the looped objects variables into scope,
 		// like 'with'.
 		ast->type = AST_LOOP;
 	}
-	else if (keywordName.cmp("while"))
+	else if (keywordName.atom == ATOM_WHILE)
 	{
 		ast->type = AST_WHILE;
 	}
@@ -423,7 +642,7 @@ internal AST* parseIdentifier(Tokenizer* tokenizer) {
 			getToken(tokenizer);
 			return ast;
 		}
-		else if (op.type == TOKEN_IDENTIFIER && op.cmp("when"))
+		else if (op.type == TOKEN_IDENTIFIER && op.atom == ATOM_WHEN)
 		{
 			getToken(tokenizer); // Skip 'when' token
 			AST_Expression* expr = parseExpression(tokenizer, PARSER_MODE_EXPRESSION_BLOCK);
@@ -466,6 +685,22 @@ internal AST* parseIdentifier(Tokenizer* tokenizer) {
 	return NULL;
 }
 
+// Moves the children collected since 'childStart' into a contiguous range of 'edges'.
+inline internal void commitChildNodes(AST* ast, Array<AST_Index>* children, s32 childStart, Array<AST_Index>* edges)
+{
+	ast->firstChild = edges->used;
+	ast->childCount = children->used - childStart;
+	for (s32 i = childStart; i < children->used; ++i)
+	{
+		if (edges->used == edges->size)
+		{
+			edges->resize(edges->size * 2);
+		}
+		edges->push(children->data[i]);
+	}
+	children->used = childStart;
+}
+
 internal AST_Layout* parseLayout(Tokenizer* tokenizer) {
 	if (!requireToken(tokenizer, TOKEN_BRACE_OPEN))
 	{
@@ -474,22 +709,36 @@ internal AST_Layout* parseLayout(Tokenizer* tokenizer) {
 
 	TemporaryPoolScope tempPool(tokenizer->poolTransient);
 	Array<AST*> nestDepth(512, tempPool);
+	Array<s32> nestChildStart(512, tempPool); // Where each nested nodes children begin in 'children'
+	Array<AST_Index> children(1024, tempPool); // Children of every node in 'nestDepth', innermost last
+	Array<AST*> nodes(1024, tempPool);
+	Array<AST_Index> edges(1024, tempPool);
 	Array<Token> variables(255, tempPool); // Keep track of variable names/count in scope
 
 	AST_Layout* ast = pushAST(AST_Layout, AST_LAYOUT, tokenizer->pool);
 	nestDepth.push(ast);
+	nestChildStart.push(children.used);
 
 	{
 		for(;;)
 		{
 			AST* top = nestDepth.top();
+			if (children.used == children.size)
+			{
+				// NOTE: At most one child is added per iteration.
+				children.resize(children.size * 2);
+			}
+			if (nodes.used == nodes.size)
+			{
+				nodes.resize(nodes.size * 2);
+			}
 
 			Token name = peekToken(tokenizer);
 			if (name.type == TOKEN_BRACE_CLOSE)
 			{
 				getToken(tokenizer);
 				// Change scope to go up one level
-				nestDepth.pop();
+				commitChildNodes(nestDepth.pop(), &children, nestChildStart.pop(), &edges);
 				// If breaking out of 'layout' block
 				if (nestDepth.used <= 0) {
 					assert(nestDepth.used == 0); // NOTE(Jake): There should never be a case where used is lower than 0.
@@ -498,14 +747,16 @@ internal AST_Layout* parseLayout(Tokenizer* tokenizer) {
 			}
 			else if (name.type == TOKEN_IDENTIFIER)
 			{
-				if (name.cmp("if") || name.cmp("loop") || name.cmp("while"))
+				if (name.atom == ATOM_IF || name.atom == ATOM_LOOP || name.atom == ATOM_WHILE)
 				{
 					AST_Expression_Block* ast = parseExpressionBlock(tokenizer);
 					ast->parent = top;
-					top->childNodes->push(ast);
+					children.push(nodes.used);
+					nodes.push(ast);
 					nestDepth.push(ast);
+					nestChildStart.push(children.used);
 				}
-				else if (name.cmp("else"))
+				else if (name.atom == ATOM_ELSE)
 				{
 					// todo(Jake): probably need to store the last-if found so that the else branch can be attached to it. (ie. ->ChildNodesElse)
 					assert(false);
@@ -515,7 +766,8 @@ internal AST_Layout* parseLayout(Tokenizer* tokenizer) {
 					AST* astTop = parseIdentifier(tokenizer);
 					assert(astTop != NULL);
 					astTop->parent = top;
-					top->childNodes->push(astTop);
+					children.push(nodes.used);
+					nodes.push(astTop);
 
 					if (astTop->type == AST_IDENTIFIER)
 					{
@@ -526,6 +778,7 @@ internal AST_Layout* parseLayout(Tokenizer* tokenizer) {
 							// If found brace after component, add to current scope
 							getToken(tokenizer);
 							nestDepth.push(ast);
+							nestChildStart.push(children.used);
 						}
 						else if (nextToken.type == TOKEN_BRACE_CLOSE || nextToken.type == TOKEN_IDENTIFIER)
 						{
@@ -540,7 +793,7 @@ internal AST_Layout* parseLayout(Tokenizer* tokenizer) {
 					else if (astTop->type == AST_STATEMENT)
 					{
 						AST_Statement* ast = (AST_Statement*)astTop;
-						if (variables.find(ast->name) == -1)
+						if (findByAtom(&variables, ast->name.atom) == -1)
 						{
 							variables.push(ast->name);
 						}
@@ -564,6 +817,12 @@ internal AST_Layout* parseLayout(Tokenizer* tokenizer) {
 		//parseError("Stuck in %d nested scope.", nestDepth.used);
 		assert(false);
 	}
+	while (nestDepth.used > 0)
+	{
+		commitChildNodes(nestDepth.pop(), &children, nestChildStart.pop(), &edges);
+	}
+	ast->nodes = nodes.createCopyExactSize(tokenizer->pool);
+	ast->edges = edges.createCopyExactSize(tokenizer->pool);
 	ast->variables = variables.createCopyShrinkToFit(tokenizer->pool);
 	return ast;
 }
@@ -574,10 +833,17 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 		return NULL;
 	}
 
+	// NOTE: Everything is collected into scratch arrays, then only what was used is copied
+	//		 onto the permanent pool.
+	TemporaryPoolScope tempPool(tokenizer->poolTransient);
+	Array<CSS_Rule*> rules(1024, tempPool);
+	Array<CSS_Property> properties(128, tempPool);
+	Array<Array<CSS_Selector>> selectorSets(64, tempPool);
+	Array<CSS_Selector> selectors(128, tempPool);
+	Array<CSS_PropertyToken> propTokens(64, tempPool);
+	Array<Token> arguments(64, tempPool);
+
 	CSS_Rule* resultRule = pushStruct(CSS_Rule, tokenizer->pool);
-	Array<CSS_Rule*>* rules = Array<CSS_Rule*>::create(1024, tokenizer->pool);
-	Array<CSS_Property>* properties = Array<CSS_Property>::create(128, tokenizer->pool);
-	Array<Array<CSS_Selector>>* selectorSets = NULL;
 
 	for (;;)
 	{
@@ -593,14 +859,12 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 		}
 		else if (first.type == TOKEN_IDENTIFIER && first.length >= 1 && first.data[0] == '@')
 		{
-			// Skip @
-			++first.data; --first.length;
 			getTokenCSSProperty(tokenizer); // skip @{keyword] token
 			// Check @ keywords
-			if (first.cmp("media"))
+			if (first.atom == ATOM_AT_MEDIA)
 			{
-				selectorSets = Array<Array<CSS_Selector>>::create(64, tokenizer->pool);
-				Array<CSS_Selector>* selectors = Array<CSS_Selector>::create(128, tokenizer->pool);
+				selectorSets.used = 0;
+				selectors.used = 0;
 				for (;;)
 				{
 					TokenizerState prevState = tokenizer->state;
@@ -619,10 +883,10 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 						// Push current array of selectors to selector set
 						// and then allocate a new one.
 						// NOTE(Jake): Ignore empty selectors, this will allow a trailing comma nicely
-						if (selectors != NULL && selectors->used > 0) {
-							selectorSets->push(*selectors);
+						if (selectors.used > 0) {
+							selectorSets.push(*selectors.createCopyExactSize(tokenizer->pool));
 						}
-						selectors = Array<CSS_Selector>::create(128, tokenizer->pool);
+						selectors.used = 0;
 						continue;
 					}
 					else if (token.type == TOKEN_PAREN_OPEN)
@@ -633,23 +897,24 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 					{
 						selector.type = CSS_SELECTOR_PAREN_CLOSE;
 					}
-					selectors->push(selector);
+					selectors.push(selector);
 				}
 
 				// Push final remaining selectorSet
-				if (selectors->used > 0)
+				if (selectors.used > 0)
 				{
-					selectorSets->push(*selectors);
+					selectorSets.push(*selectors.createCopyExactSize(tokenizer->pool));
 				}
+				Array<Array<CSS_Selector>>* ruleSelectorSets = selectorSets.createCopyExactSize(tokenizer->pool);
 
 				CSS_Rule* subRule = parseStyle(tokenizer);
 				assert(subRule != NULL);
 				if (subRule != NULL)
 				{
 					subRule->type = CSS_RULE_MEDIAQUERY;
-					subRule->selectorSets = selectorSets;
+					subRule->selectorSets = ruleSelectorSets;
 					subRule->parent = resultRule;
-					rules->push(subRule);
+					rules.push(subRule);
 				}
 			}
 			else
@@ -667,7 +932,7 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 			// NOTE(Jake): idea, expressions can only be inside 'calc()'
 			CSS_Property prop = {};
 			prop.name = token;
-			prop.tokens = Array<CSS_PropertyToken>::create(64, tokenizer->pool);
+			propTokens.used = 0;
 			for (;;)
 			{
 				CSS_PropertyToken propToken;
@@ -680,27 +945,28 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 					if (paren.type == TOKEN_PAREN_OPEN)
 					{
 						getToken(tokenizer); // skip TOKEN_PAREN_OPEN
-						propToken.arguments = Array<Token>::create(64, tokenizer->pool);
+						arguments.used = 0;
 						s32 commaCount = 0;
 						for (;;)
 						{
 							Token token = getTokenCSSProperty(tokenizer);
 							if (token.type == TOKEN_NUMBER)
 							{
-								propToken.arguments->push(token);
+								arguments.push(token);
 							}
 							else if (token.type == TOKEN_COMMA)
 							{
 								// no-op
 								++commaCount;
-								if (commaCount != propToken.arguments->used)
+								if (commaCount != arguments.used)
 								{
-									parseError(token, "Missing parameter %d.", propToken.arguments->used + 1);
+									parseError(token, "Missing parameter %d.", arguments.used + 1);
 								}
 							}
 							else if (token.type == TOKEN_PAREN_CLOSE)
 							{
 								// end parameter list
+								propToken.arguments = arguments.createCopyExactSize(tokenizer->pool);
 								break;
 							}
 							else
@@ -709,17 +975,17 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 							}
 						}
 					}
-					prop.tokens->push(propToken);
+					propTokens.push(propToken);
 				}
 				else if (token.type == TOKEN_NUMBER
 						|| token.type == TOKEN_HEX)
 				{
 					// NOTE(Jake): perhaps store more info at this level, ie. TOKEN_NUMBER_PX, TOKEN_NUMBER_EM, TOKEN_NUMBER_PERCENT ?
-					prop.tokens->push(propToken);
+					propTokens.push(propToken);
 				}
 				else if (token.type == TOKEN_COMMA)
 				{
-					prop.tokens->push(propToken);
+					propTokens.push(propToken);
 				}
 				else if (token.type == TOKEN_SEMICOLON
 						|| token.type == TOKEN_NEWLINE)
@@ -735,19 +1001,23 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 					assert(false);
 				}
 			}
-			properties->push(prop);
+			prop.tokens = propTokens.createCopyExactSize(tokenizer->pool);
+			properties.push(prop);
 		}
 		else
 		{
 			// Read selectors that make up the CSS rule (ie. '.myDiv > .heyThere + .wow')
-			selectorSets = Array<Array<CSS_Selector>>::create(64, tokenizer->pool);
-			Array<CSS_Selector>* selectors = Array<CSS_Selector>::create(128, tokenizer->pool);
+			selectorSets.used = 0;
+			selectors.used = 0;
+			char* previousEnd = NULL; // End of the last selector read, to find selectors with no whitespace between them
 			for (;;)
 			{
 				TokenizerState prevState = tokenizer->state;
 				Token token = getTokenCSSProperty(tokenizer);
 				CSS_Selector selector = {};
 				selector.token = token;
+				selector.isCompound = (selectors.used > 0 && token.data == previousEnd);
+				previousEnd = token.data + token.length;
 				if (token.type == TOKEN_IDENTIFIER)
 				{
 					if (token.data[0] == '.')
@@ -817,6 +1087,11 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 							assert(false);
 							return NULL;
 						}
+						previousEnd = endBracket.data + endBracket.length;
+					}
+					else
+					{
+						previousEnd = op.data + op.length;
 					}
 					selector.type = CSS_SELECTOR_ATTRIBUTE;
 					selector.attribute.name = name;
@@ -828,10 +1103,10 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 					// Push current array of selectors to selector set
 					// and then allocate a new one.
 					// NOTE(Jake): Ignore empty selectors, this will allow a trailing comma nicely
-					if (selectors != NULL && selectors->used > 0) {
-						selectorSets->push(*selectors);
+					if (selectors.used > 0) {
+						selectorSets.push(*selectors.createCopyExactSize(tokenizer->pool));
 					}
-					selectors = Array<CSS_Selector>::create(128, tokenizer->pool);
+					selectors.used = 0;
 					continue;
 				}
 				else if (token.type == TOKEN_BRACE_OPEN)
@@ -845,30 +1120,29 @@ internal CSS_Rule* parseStyle(Tokenizer* tokenizer) {
 					assert(false);
 				}
 				assert(selector.type != CSS_SELECTOR_UNKNOWN);
-				selectors->push(selector);
+				selectors.push(selector);
 			}
 
 			// Push current array of selectors to selector set
-			if (selectors != NULL && selectors->used > 0) {
-				selectorSets->push(*selectors);
+			if (selectors.used > 0) {
+				selectorSets.push(*selectors.createCopyExactSize(tokenizer->pool));
 			}
+			Array<Array<CSS_Selector>>* ruleSelectorSets = selectorSets.createCopyExactSize(tokenizer->pool);
 
 			CSS_Rule* subRule = parseStyle(tokenizer);
 			assert(subRule != NULL);
 			if (subRule != NULL)
 			{
 				subRule->type = CSS_RULE_SELECTOR;
-				subRule->selectorSets = selectorSets;
+				subRule->selectorSets = ruleSelectorSets;
 				subRule->parent = resultRule;
-				rules->push(subRule);
+				rules.push(subRule);
 			}
 		}
 	}
 
-	assert(rules != NULL && properties != NULL)
-	
-	resultRule->childRules = rules;
-	resultRule->properties = properties;
+	resultRule->childRules = rules.createCopyExactSize(tokenizer->pool);
+	resultRule->properties = properties.createCopyExactSize(tokenizer->pool);
 	return resultRule;
 }
 
@@ -905,9 +1179,10 @@ internal AST_ComponentDefinition* parseComponentDefinition(Tokenizer* tokenizer)
 	}
 
 	// Blocks
+	TemporaryPoolScope tempPool(tokenizer->poolTransient);
+	Array<AST_ComponentDefinition*> components(1024, tempPool);
 	AST_ComponentDefinition* definition = pushAST(AST_ComponentDefinition, AST_COMPONENTDEFINITION, tokenizer->pool);
 	definition->name = componentName;
-	definition->components = Array<AST_ComponentDefinition*>::create(1024, tokenizer->pool);
 	s32 layoutBlockCount = 0;
 	s32 styleBlockCount = 0;
 	s32 propertiesBlockCount = 0;
@@ -917,7 +1192,7 @@ internal AST_ComponentDefinition* parseComponentDefinition(Tokenizer* tokenizer)
 		Token token = getToken(tokenizer);
 		if (token.type == TOKEN_IDENTIFIER)
 		{
-			if (token.cmp("properties"))
+			if (token.atom == ATOM_PROPERTIES)
 			{
 				if (styleBlockCount >= 1)
 				{
@@ -932,7 +1207,7 @@ internal AST_ComponentDefinition* parseComponentDefinition(Tokenizer* tokenizer)
 				}
 				++propertiesBlockCount;
 			}
-			else if (token.cmp("style"))
+			else if (token.atom == ATOM_STYLE)
 			{
 				if (styleBlockCount >= 1)
 				{
@@ -950,11 +1225,11 @@ internal AST_ComponentDefinition* parseComponentDefinition(Tokenizer* tokenizer)
 				}
 				++styleBlockCount;
 			}
-			else if (token.cmp("script"))
+			else if (token.atom == ATOM_SCRIPT)
 			{
 				assert(false);
 			}
-			else if (token.cmp("layout"))
+			else if (token.atom == ATOM_LAYOUT)
 			{
 				if (layoutBlockCount >= 1)
 				{
@@ -966,11 +1241,11 @@ internal AST_ComponentDefinition* parseComponentDefinition(Tokenizer* tokenizer)
 				definition->layout->parent = definition;
 				++layoutBlockCount;
 			}
-			else if (token.cmp("def"))
+			else if (token.atom == ATOM_DEF)
 			{
 				AST_ComponentDefinition* ast = parseComponentDefinition(tokenizer);
 				if (ast != NULL) {
-					definition->components->push(ast);
+					components.push(ast);
 				}
 			}
 			else
@@ -985,17 +1260,26 @@ internal AST_ComponentDefinition* parseComponentDefinition(Tokenizer* tokenizer)
 		}
 	}
 
+	definition->components = components.createCopyExactSize(tokenizer->pool);
 	return definition;
 }
 
-void parse(Compiler* compiler, String pathname) {
-	AST_File ast_file;
-	zeroMemory(&ast_file, sizeof(ast_file));
+// Lexes and parses a single file, allocating its AST on 'pool'. If 'cacheDirectory' is set, the AST
+// is loaded from there when the file hasn't changed, otherwise it's parsed and then saved there.
+// NOTE: A snapshot is a copy of all of 'pool', so when caching each file should have its own.
+// Returns false if the file was skipped. If 'hasParseError' is given, parse errors are reported and
+// set it rather than asserting, anything allocated on 'pool' is then garbage.
+bool parseFile(AST_File* ast_file, String pathname, u16 fileId, AtomTable* atoms, String cacheDirectory, AllocatorPool* pool, AllocatorPool* poolTransient, bool* hasParseError = NULL) {
+	zeroMemory(ast_file, sizeof(*ast_file));
+	if (hasParseError)
+	{
+		*hasParseError = false;
+	}
 
 	// Read filenames
 	String basename = pathname.basename();
 	File::Error fileError;
-	String fileContents = File::readEntireFile(pathname, &fileError);
+	String fileContents = File::mapEntireFile(pathname, &fileError);
 	if (fileContents.data == NULL) 
 	{
 		if (fileError.errorCode)
@@ -1019,7 +1303,16 @@ void parse(Compiler* compiler, String pathname) {
 		{
 			printf("Skipping '%s', file is empty.\n", basename.data);
 		}
-		return;
+		return false;
+	}
+
+	if (cacheDirectory.length > 0)
+	{
+		if (loadASTCache(ast_file, pathname, fileId, fileContents, cacheDirectory, atoms))
+		{
+			printf("Loaded '%s' from cache.\n", basename.data);
+			return true;
+		}
 	}
 
 	printf("Lexing '%s'...\n", basename.data);
@@ -1028,16 +1321,36 @@ void parse(Compiler* compiler, String pathname) {
 	u32 tokenCount = 0;
 	Tokenizer tokenizer;
 	zeroMemory(&tokenizer, sizeof(Tokenizer));
-	tokenizer.pool = compiler->pool;
-	tokenizer.poolTransient = compiler->poolTransient;
+	tokenizer.atoms = atoms;
+	tokenizer.pool = pool;
+	tokenizer.poolTransient = poolTransient;
 	tokenizer.string = fileContents;
-	tokenizer.pathName = pathname;
+	tokenizer.fileId = fileId;
 	tokenizer.state.at = tokenizer.string.data;
 	tokenizer.state.lineNumber = 0;
 
-	ast_file.pathname = pathname;
-	ast_file.layouts = Array<AST_Layout>::create(1024, tokenizer.pool);
-	ast_file.components = Array<AST_ComponentDefinition>::create(1024, tokenizer.pool);
+	ast_file->pathname = pathname;
+	ast_file->contentHash = hashString64(fileContents);
+	ast_file->source = fileContents;
+	TemporaryPoolScope tempPool(poolTransient);
+	Array<AST_Layout> layouts(1024, tempPool);
+	Array<AST_ComponentDefinition> components(1024, tempPool);
+
+	jmp_buf errorJump;
+	s32 tempCount = poolTransient->tempCount;
+	if (hasParseError)
+	{
+		tokenizer.errorJump = &errorJump;
+		if (setjmp(errorJump) != 0)
+		{
+			// NOTE: Scopes between here and the error never ended, 'tempPool' rolls back what they used.
+			poolTransient->tempCount = tempCount;
+			File::unmapEntireFile(fileContents);
+			zeroMemory(ast_file, sizeof(*ast_file));
+			*hasParseError = true;
+			return false;
+		}
+	}
 
 	for(;;)
 	{
@@ -1048,62 +1361,266 @@ void parse(Compiler* compiler, String pathname) {
 		}
 		else if (token.type == TOKEN_IDENTIFIER)
 		{
-			if (token.cmp("layout"))
+			if (token.atom == ATOM_LAYOUT)
 			{
 				AST_Layout* layout = parseLayout(&tokenizer);
 				if (layout != NULL)
 				{
-					ast_file.layouts->push(*layout);
+					layouts.push(*layout);
 				}
 			}
-			else if (token.cmp("def"))
+			else if (token.atom == ATOM_DEF)
 			{
 				AST_ComponentDefinition* componentDefinition = parseComponentDefinition(&tokenizer);
 				if (componentDefinition != NULL)
 				{
-					ast_file.components->push(*componentDefinition);
+					components.push(*componentDefinition);
 				}
 			}
-			else if (token.cmp("func"))
+			else if (token.atom == ATOM_FUNC)
 			{
 				AST_FunctionDefinition* functionDefinition = parseFunctionDefinition(&tokenizer);
-				assert(false);
+				print("Parse error(%d): Functions aren't supported yet.\n", token.lineNumber);
+				tokenizerErrorJump(&tokenizer);
 			}
 			else
 			{
-				assert(false);
+				print("Parse error(%d): Expected 'layout' or 'def', instead got '%s'.\n", token.lineNumber, &token);
+				tokenizerErrorJump(&tokenizer);
 			}
 		}
 		else
 		{
-			assert(false);
+			print("Parse error(%d): Expected 'layout' or 'def', instead got '%s'.\n", token.lineNumber, &token);
+			tokenizerErrorJump(&tokenizer);
 		}
 		//tokenArray.push(token);
 	}
+	ast_file->layouts = layouts.createCopyExactSize(pool);
+	ast_file->components = components.createCopyExactSize(pool);
 
+	if (cacheDirectory.length > 0 && !saveASTCache(ast_file, fileContents, cacheDirectory, pool, poolTransient))
+	{
+		printf("Unable to cache '%s'.\n", basename.data);
+	}
+
+	//if (hasErrors)
+	{
+		//printf("'%s' contained errors. Stopping.\n", basename.data);
+	}
+	return true;
+}
+
+// Frees the files contents, AST cache mapping and arena, only once nothing points into the AST.
+inline void freeASTFile(AST_File* ast_file)
+{
+	File::unmapEntireFile(ast_file->snapshot);
+	File::unmapEntireFile(ast_file->source);
+	if (ast_file->pool != NULL)
+	{
+		ast_file->pool->free();
+	}
+	ast_file->snapshot.data = NULL;
+	ast_file->source.data = NULL;
+	ast_file->pool = NULL;
+}
+
+inline void addParsedFile(Compiler* compiler, AST_File* ast_file)
+{
 	// Debug Print info
 	printf("\n");
-	printf("Layouts found: %d\n", ast_file.layouts->used);
-	for (s32 i = 0; i < ast_file.layouts->used; ++i)
+	printf("Layouts found: %d\n", ast_file->layouts->used);
+	for (s32 i = 0; i < ast_file->layouts->used; ++i)
 	{
-		AST_Layout* it = &ast_file.layouts->data[i];
+		AST_Layout* it = &ast_file->layouts->data[i];
 		printAST(compiler, it);
 	}
 	printf("\n");
-	printf("Components found: %d\n", ast_file.components->used);
-	for (s32 i = 0; i < ast_file.components->used; ++i)
+	printf("Components found: %d\n", ast_file->components->used);
+	for (s32 i = 0; i < ast_file->components->used; ++i)
 	{
-		AST_ComponentDefinition* it = &ast_file.components->data[i];
+		AST_ComponentDefinition* it = &ast_file->components->data[i];
 		printAST(compiler, it);
 	}
 	printf("\n");
 
-	//if (hasErrors)
+	compiler->astFiles->push(*ast_file);
+}
+
+// Returns the ID tokens from 'pathname' are tagged with, adding the file if it's new.
+// NOTE: Not thread-safe, IDs are handed out before parsing starts.
+// Returns false if every ID is taken, as tokens only have 16-bits to store it.
+bool getFileId(Compiler* compiler, String pathname, u16* fileId) {
+	u16* existingId = compiler->fileIds->find(pathname);
+	if (existingId != NULL)
 	{
-		//printf("'%s' contained errors. Stopping.\n", basename.data);
+		*fileId = *existingId;
+		return true;
+	}
+	Array<String>* filePathnames = compiler->filePathnames;
+	if (filePathnames->used > 0xFFFF)
+	{
+		print("Too many files, the limit is %d. File = %s\n", 0xFFFF + 1, &pathname);
+		return false;
+	}
+	if (filePathnames->used == filePathnames->size)
+	{
+		filePathnames->resize(filePathnames->size * 2);
+	}
+	filePathnames->push(pathname);
+	*fileId = (u16)(filePathnames->used - 1);
+	*compiler->fileIds->findOrAdd(pathname) = *fileId;
+	return true;
+}
+
+void parse(Compiler* compiler, String pathname) {
+	u16 fileId;
+	if (!getFileId(compiler, pathname, &fileId))
+	{
+		compiler->hasError = true;
+		return;
+	}
+	AllocatorPool* pool = compiler->pool;
+	if (compiler->cacheDirectory.length > 0)
+	{
+		pool = AllocatorPool::createFromOS(Kilobytes(256));
 	}
+	AST_File ast_file;
+	if (parseFile(&ast_file, pathname, fileId, compiler->atoms, compiler->cacheDirectory, pool, compiler->poolTransient))
+	{
+		if (pool != compiler->pool)
+		{
+			ast_file.pool = pool;
+		}
+		addParsedFile(compiler, &ast_file);
+	}
+	else if (pool != compiler->pool)
+	{
+		pool->free();
+	}
+}
+
+//
+// Parallel parsing
+//
+struct ParseWorkQueue {
+	Array<String>* pathnames;
+	u16* fileIds;
+	AST_File* results;
+	bool* resultIsValid;
+	AtomTable* atoms;
+	String cacheDirectory;
+	bool isWatching; // Parse errors skip the file rather than asserting
+	bool isPoolPerFile; // Caching or watching, see 'AST_File::pool'
+	volatile s32 nextIndex;
+};
 
-	compiler->astFiles->push(ast_file);
+struct ParseWorker {
+	ParseWorkQueue* queue;
+	AllocatorPool* pool;
+	AllocatorPool* poolTransient;
+};
+
+internal void parseWorkerProc(void* data)
+{
+	ParseWorker* worker = (ParseWorker*)data;
+	ParseWorkQueue* queue = worker->queue;
+	for (;;)
+	{
+		s32 index = Thread::atomicIncrement(&queue->nextIndex) - 1;
+		if (index >= queue->pathnames->used)
+		{
+			break;
+		}
+		AllocatorPool* pool = worker->pool;
+		if (queue->isPoolPerFile)
+		{
+			pool = AllocatorPool::createFromOS(Kilobytes(256));
+		}
+		bool hasParseError = false;
+		AST_File* ast_file = &queue->results[index];
+		queue->resultIsValid[index] = parseFile(ast_file, queue->pathnames->data[index], queue->fileIds[index], queue->atoms, queue->cacheDirectory, pool, worker->poolTransient, queue->isWatching ? &hasParseError : NULL);
+		if (queue->isPoolPerFile)
+		{
+			if (queue->resultIsValid[index])
+			{
+				ast_file->pool = pool;
+			}
+			else
+			{
+				pool->free();
+			}
+		}
+	}
+}
+
+// Parses every '.fel' file across all cores. Each worker allocates into its own arena, the
+// results are then added to 'compiler->astFiles' in the same order as 'files'.
+void parseFiles(Compiler* compiler, StringLinkedList files) {
+	Array<String>* pathnames = Array<String>::create(files.used, compiler->pool);
+	for (StringLinkedListNode* node = files.first; node != NULL; node = node->next)
+	{
+		// Only parse files with the '.fel' extension
+		if (node->string.fileExtension().cmp("fel"))
+		{
+			pathnames->push(node->string);
+		}
+	}
+	if (pathnames->used == 0)
+	{
+		return;
+	}
+
+	ParseWorkQueue queue;
+	zeroMemory(&queue, sizeof(queue));
+	queue.pathnames = pathnames;
+	queue.fileIds = pushArrayStruct(u16, pathnames->used, compiler->pool);
+	for (s32 i = 0; i < pathnames->used; ++i)
+	{
+		if (!getFileId(compiler, pathnames->data[i], &queue.fileIds[i]))
+		{
+			compiler->hasError = true;
+			return;
+		}
+	}
+	queue.atoms = compiler->atoms;
+	queue.cacheDirectory = compiler->cacheDirectory;
+	queue.isWatching = compiler->isWatching;
+	// NOTE: Snapshots copy the whole arena and watching frees a files arena when it changes.
+	queue.isPoolPerFile = compiler->cacheDirectory.length > 0 || compiler->isWatching;
+	queue.results = pushArrayStruct(AST_File, pathnames->used, compiler->pool);
+	queue.resultIsValid = pushArrayStruct(bool, pathnames->used, compiler->pool);
+
+	s32 workerCount = Thread::getProcessorCount();
+	if (workerCount > pathnames->used)
+	{
+		workerCount = pathnames->used;
+	}
+
+	// NOTE: The workers arenas are never freed as the AST lives in them.
+	ParseWorker* workers = pushArrayStruct(ParseWorker, workerCount, compiler->pool);
+	for (s32 i = 0; i < workerCount; ++i)
+	{
+		ParseWorker* worker = &workers[i];
+		worker->queue = &queue;
+		worker->pool = AllocatorPool::createFromOS(Megabytes(4));
+		worker->poolTransient = worker->pool->create(Megabytes(1));
+	}
+
+	void** workerData = pushArrayStruct(void*, workerCount, compiler->pool);
+	for (s32 i = 0; i < workerCount; ++i)
+	{
+		workerData[i] = &workers[i];
+	}
+	Thread::runWorkers(parseWorkerProc, workerData, workerCount);
+
+	for (s32 i = 0; i < pathnames->used; ++i)
+	{
+		if (queue.resultIsValid[i])
+		{
+			addParsedFile(compiler, &queue.results[i]);
+		}
+	}
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,544 @@
+#include "file.h"
+#include "array.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+
+// NOTE: glibc only exposes getdents64() from 2.30 onwards, so call it directly.
+struct linux_dirent64 {
+	u64 d_ino;
+	s64 d_off;
+	u16 d_reclen;
+	u8 d_type;
+	char d_name[1];
+};
+
+#ifndef DT_UNKNOWN
+#define DT_UNKNOWN 0
+#define DT_DIR 4
+#define DT_REG 8
+#endif
+
+namespace File
+{
+	String mapEntireFile(String filename, Error* error, bool writable) {
+		if (error) {
+			zeroMemory(error, sizeof(File::Error));
+		}
+		String sNull = {};
+
+		char cFilename[PATH_MAX];
+		filename.toCString(cFilename, ArrayCount(cFilename));
+
+		s32 fd = open(cFilename, O_RDONLY);
+		if (fd == -1)
+		{
+			print("mapEntireFile:: Invalid file. File = %s\n", &filename);
+			if (error) {
+				error->errorCode = FILE_CANT_OPEN;
+			}
+			return sNull;
+		}
+
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+		{
+			close(fd);
+			return sNull;
+		}
+		memory_index fsize = (memory_index)fileStat.st_size;
+
+		// Reserve zeroed pages with room for at least one byte past the end of the file, then map
+		// the file over the front of it. The lexer relies on the contents being null terminated,
+		// which wouldn't hold for a file that is an exact multiple of the page size.
+		memory_index pageSize = (memory_index)sysconf(_SC_PAGESIZE);
+		memory_index mapSize = (fsize + 1 + pageSize - 1) & ~(pageSize - 1);
+		s32 protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+		void* base = mmap(NULL, mapSize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+		{
+			close(fd);
+			print("mapEntireFile:: Memory allocation error. Size = %d\n", (s32)mapSize);
+			if (error) {
+				error->errorCode = FILE_NO_MEMORY;
+			}
+			return sNull;
+		}
+		void* fileData = mmap(base, fsize, protection, MAP_PRIVATE | MAP_FIXED, fd, 0);
+		close(fd);
+		if (fileData == MAP_FAILED)
+		{
+			munmap(base, mapSize);
+			print("mapEntireFile:: Unable to map file. File = %s\n", &filename);
+			if (error) {
+				error->errorCode = FILE_CANT_OPEN;
+			}
+			return sNull;
+		}
+
+		String sfileData = {};
+		sfileData.data = (char*)fileData;
+		sfileData.length = (s32)fsize;
+		return sfileData;
+	}
+
+	bool exists(String filename)
+	{
+		char cFilename[PATH_MAX];
+		filename.toCString(cFilename, ArrayCount(cFilename));
+		struct stat fileStat;
+		return stat(cFilename, &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+	}
+
+	void unmapEntireFile(String contents)
+	{
+		if (contents.data == NULL)
+		{
+			return;
+		}
+		// NOTE: Same size as reserved in 'mapEntireFile'
+		memory_index pageSize = (memory_index)sysconf(_SC_PAGESIZE);
+		memory_index mapSize = ((memory_index)contents.length + 1 + pageSize - 1) & ~(pageSize - 1);
+		munmap(contents.data, mapSize);
+	}
+
+	inline internal bool toStreamTempPath(String filename, char* dest, s32 destLength)
+	{
+		if (filename.length + 5 > destLength)
+		{
+			return false;
+		}
+		filename.toCString(dest, destLength);
+		memcpy(dest + filename.length, ".tmp", 5);
+		return true;
+	}
+
+	// NOTE: The file descriptor is stored +1 so that a zeroed Stream is never valid.
+	Stream openStream(String filename, Error* error)
+	{
+		if (error) {
+			zeroMemory(error, sizeof(File::Error));
+		}
+		Stream stream = {};
+		char cTempPath[PATH_MAX];
+		s32 fd = -1;
+		if (toStreamTempPath(filename, cTempPath, ArrayCount(cTempPath)))
+		{
+			fd = open(cTempPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		}
+		else
+		{
+			errno = ENAMETOOLONG;
+		}
+		if (fd == -1)
+		{
+			s32 errorNumber = errno;
+			print("openStream:: Unable to open file for writing. File = %s, errno = %d\n", &filename, errorNumber);
+			if (error) {
+				error->errorCode = FILE_CANT_OPEN;
+			}
+			return stream;
+		}
+		stream.platformHandle = (void*)((memory_index)fd + 1);
+		stream.filename = filename;
+		return stream;
+	}
+
+	void writeStream(Stream* stream, String* parts, s32 partCount)
+	{
+		assert(stream->platformHandle != NULL);
+		s32 fd = (s32)((memory_index)stream->platformHandle - 1);
+
+		iovec vectors[8];
+		assert(partCount > 0 && partCount <= (s32)ArrayCount(vectors));
+		s32 vectorCount = 0;
+		for (s32 i = 0; i < partCount; ++i)
+		{
+			if (parts[i].length > 0)
+			{
+				vectors[vectorCount].iov_base = parts[i].data;
+				vectors[vectorCount].iov_len = (size_t)parts[i].length;
+				++vectorCount;
+			}
+		}
+
+		iovec* vector = vectors;
+		while (vectorCount > 0 && !stream->hasError)
+		{
+			ssize_t bytesWritten = writev(fd, vector, vectorCount);
+			if (bytesWritten < 0)
+			{
+				if (errno != EINTR)
+				{
+					stream->hasError = true;
+				}
+				continue;
+			}
+			// Skip past whatever was written, writev can stop part way through.
+			while (vectorCount > 0 && (size_t)bytesWritten >= vector->iov_len)
+			{
+				bytesWritten -= vector->iov_len;
+				++vector;
+				--vectorCount;
+			}
+			if (vectorCount > 0)
+			{
+				vector->iov_base = (char*)vector->iov_base + bytesWritten;
+				vector->iov_len -= bytesWritten;
+			}
+		}
+	}
+
+	bool closeStream(Stream* stream)
+	{
+		assert(stream->platformHandle != NULL);
+		s32 fd = (s32)((memory_index)stream->platformHandle - 1);
+		stream->hasError = (close(fd) != 0) || stream->hasError;
+		stream->platformHandle = NULL;
+
+		char cFilename[PATH_MAX];
+		char cTempPath[PATH_MAX];
+		stream->filename.toCString(cFilename, ArrayCount(cFilename));
+		toStreamTempPath(stream->filename, cTempPath, ArrayCount(cTempPath));
+		if (!stream->hasError && rename(cTempPath, cFilename) != 0)
+		{
+			stream->hasError = true;
+		}
+		if (stream->hasError)
+		{
+			unlink(cTempPath);
+		}
+		return !stream->hasError;
+	}
+}
+
+namespace Directory
+{
+	inline internal String joinPath(AllocatorPool* pool, String directory, char* name, s32 nameLength)
+	{
+		String result = {};
+		result.length = directory.length + 1 + nameLength;
+		result.data = (char*)pushSizeUninitialized(result.length + 1, pool); // +1 for null-termination
+		memcpy(result.data, directory.data, directory.length);
+		result.data[directory.length] = '/';
+		memcpy(result.data + directory.length + 1, name, nameLength);
+		result.data[result.length] = '\0';
+		return result;
+	}
+
+	StringLinkedList getFilesRecursive(AllocatorPool* pool, String directory, Error* error)
+	{
+		if (directory.length == 0)
+		{
+			StringLinkedList nullResult = {};
+			return nullResult;
+		}
+
+		char* lastCharacter = &directory.data[directory.length - 1];
+		if (lastCharacter[0] == '/' || lastCharacter[0] == '\\')
+		{
+			// Trim trailing back-or-forward slash
+			directory.length -= 1;
+		}
+		assert(directory.length < PATH_MAX);
+
+		// NOTE: Directories still to be searched. Grows as needed rather than having a fixed limit.
+		Array<String>* directories = Array<String>::create(64, pool);
+		String baseDir = {};
+		baseDir.length = directory.length;
+		baseDir.data = (char*)pushSize(directory.length + 1, pool);
+		memcpy(baseDir.data, directory.data, directory.length);
+		directories->push(baseDir);
+
+		char direntBuffer[Kilobytes(32)];
+		StringLinkedList list = {};
+		while (directories->used > 0)
+		{
+			String currentDirectory = directories->pop();
+
+			s32 fd = openat(AT_FDCWD, currentDirectory.data, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd == -1)
+			{
+				if (currentDirectory.data == baseDir.data)
+				{
+					if (error)
+					{
+						error->errorCode = DIRECTORY_INVALID_DIR;
+					}
+					StringLinkedList list_null = {};
+					return list_null;
+				}
+				// Skip subdirectories we can't read
+				continue;
+			}
+
+			for (;;)
+			{
+				s64 bytesRead = syscall(SYS_getdents64, fd, direntBuffer, sizeof(direntBuffer));
+				if (bytesRead <= 0)
+				{
+					break;
+				}
+				for (s64 offset = 0; offset < bytesRead;)
+				{
+					linux_dirent64* entry = (linux_dirent64*)(direntBuffer + offset);
+					offset += entry->d_reclen;
+
+					char* name = entry->d_name;
+					if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+					{
+						continue;
+					}
+
+					u8 type = entry->d_type;
+					if (type == DT_UNKNOWN)
+					{
+						// Some filesystems don't fill in d_type, fallback to stat.
+						struct stat entryStat;
+						if (fstatat(fd, name, &entryStat, AT_SYMLINK_NOFOLLOW) != 0)
+						{
+							continue;
+						}
+						type = S_ISDIR(entryStat.st_mode) ? DT_DIR : (S_ISREG(entryStat.st_mode) ? DT_REG : DT_UNKNOWN);
+					}
+
+					if (type == DT_DIR)
+					{
+						// Push this directory to be searched next iteration.
+						if (directories->used == directories->size)
+						{
+							directories->resize(directories->size * 2);
+						}
+						directories->push(joinPath(pool, currentDirectory, name, (s32)strlen(name)));
+					}
+					else if (type == DT_REG)
+					{
+						String string = joinPath(pool, currentDirectory, name, (s32)strlen(name));
+						list.add(string, pool);
+					}
+				}
+			}
+			close(fd);
+		}
+
+		if (list.first == NULL && error)
+		{
+			error->errorCode = DIRECTORY_NO_FILES;
+		}
+		return list;
+	}
+
+	bool create(String directory)
+	{
+		char cDirectory[PATH_MAX];
+		if (directory.length >= (s32)ArrayCount(cDirectory))
+		{
+			return false;
+		}
+		directory.toCString(cDirectory, ArrayCount(cDirectory));
+		if (mkdir(cDirectory, 0755) == 0)
+		{
+			return true;
+		}
+		struct stat directoryStat;
+		return stat(cDirectory, &directoryStat) == 0 && S_ISDIR(directoryStat.st_mode);
+	}
+
+	struct Watcher {
+		s32 fd;
+		Array<String>* directories; // Indexed by inotify watch descriptor
+		AllocatorPool* pool;
+	};
+
+	inline internal void addUnique(StringLinkedList* list, String string, AllocatorPool* pool)
+	{
+		for (StringLinkedListNode* node = list->first; node != NULL; node = node->next)
+		{
+			if (node->string.cmp(string))
+			{
+				return;
+			}
+		}
+		list->add(string, pool);
+	}
+
+	// NOTE: inotify isn't recursive so every directory needs its own watch. Files found along the
+	//		 way are added to 'files', for directories created after watching started.
+	internal void addWatchRecursive(Watcher* watcher, String directory, StringLinkedList* files, AllocatorPool* pool)
+	{
+		const u32 mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE;
+		Array<String>* directories = Array<String>::create(16, watcher->pool);
+		directories->push(directory);
+		while (directories->used > 0)
+		{
+			String currentDirectory = directories->pop();
+			s32 wd = inotify_add_watch(watcher->fd, currentDirectory.data, mask | IN_ONLYDIR);
+			if (wd < 0)
+			{
+				continue;
+			}
+			while (watcher->directories->used <= wd)
+			{
+				if (watcher->directories->used == watcher->directories->size)
+				{
+					watcher->directories->resize(watcher->directories->size * 2);
+				}
+				String empty = {};
+				watcher->directories->push(empty);
+			}
+			watcher->directories->data[wd] = currentDirectory;
+
+			DIR* dir = opendir(currentDirectory.data);
+			if (dir == NULL)
+			{
+				continue;
+			}
+			for (struct dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+			{
+				char* name = entry->d_name;
+				if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+				{
+					continue;
+				}
+				String path = joinPath(watcher->pool, currentDirectory, name, (s32)strlen(name));
+				struct stat entryStat;
+				if (stat(path.data, &entryStat) != 0)
+				{
+					continue;
+				}
+				if (S_ISDIR(entryStat.st_mode))
+				{
+					if (directories->used == directories->size)
+					{
+						directories->resize(directories->size * 2);
+					}
+					directories->push(path);
+				}
+				else if (files != NULL && S_ISREG(entryStat.st_mode))
+				{
+					addUnique(files, path, pool);
+				}
+			}
+			closedir(dir);
+		}
+	}
+
+	Watcher* watch(String directory, AllocatorPool* pool)
+	{
+		s32 fd = inotify_init1(IN_CLOEXEC);
+		if (fd == -1)
+		{
+			return NULL;
+		}
+		if (directory.length > 1 && (directory.data[directory.length - 1] == '/' || directory.data[directory.length - 1] == '\\'))
+		{
+			// Trim trailing back-or-forward slash
+			directory.length -= 1;
+		}
+		assert(directory.length < PATH_MAX);
+
+		Watcher* watcher = pushStruct(Watcher, pool);
+		watcher->fd = fd;
+		watcher->pool = pool;
+		watcher->directories = Array<String>::create(64, pool);
+		String baseDir = {};
+		baseDir.length = directory.length;
+		baseDir.data = (char*)pushSizeUninitialized(directory.length + 1, pool);
+		memcpy(baseDir.data, directory.data, directory.length);
+		baseDir.data[baseDir.length] = '\0';
+		addWatchRecursive(watcher, baseDir, NULL, pool);
+		if (watcher->directories->used == 0)
+		{
+			close(fd);
+			return NULL;
+		}
+		return watcher;
+	}
+
+	StringLinkedList waitForChanges(Watcher* watcher, AllocatorPool* pool, Error* error)
+	{
+		if (error) {
+			zeroMemory(error, sizeof(Directory::Error));
+		}
+		// NOTE: Aligned for inotify_event
+		union {
+			inotify_event event;
+			char data[Kilobytes(16)];
+		} buffer;
+
+		StringLinkedList result = {};
+		s32 timeout = -1;
+		for (;;)
+		{
+			pollfd pollFd = {};
+			pollFd.fd = watcher->fd;
+			pollFd.events = POLLIN;
+			s32 ready = poll(&pollFd, 1, timeout);
+			if (ready < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (ready == 0)
+			{
+				// Timed out waiting for more events, return what we have.
+				break;
+			}
+			ssize_t bytesRead = (ready > 0) ? read(watcher->fd, buffer.data, sizeof(buffer)) : -1;
+			if (bytesRead < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (bytesRead <= 0)
+			{
+				if (error) {
+					error->errorCode = DIRECTORY_CANT_WATCH;
+				}
+				zeroMemory(&result, sizeof(result));
+				break;
+			}
+			for (ssize_t offset = 0; offset < bytesRead;)
+			{
+				inotify_event* event = (inotify_event*)(buffer.data + offset);
+				offset += sizeof(inotify_event) + event->len;
+				if (event->len == 0 || event->wd < 0 || event->wd >= watcher->directories->used)
+				{
+					continue;
+				}
+				String directory = watcher->directories->data[event->wd];
+				if (directory.length == 0)
+				{
+					continue;
+				}
+				if (event->mask & IN_ISDIR)
+				{
+					if (event->mask & (IN_CREATE | IN_MOVED_TO))
+					{
+						String path = joinPath(watcher->pool, directory, event->name, (s32)strlen(event->name));
+						addWatchRecursive(watcher, path, &result, pool);
+					}
+					continue;
+				}
+				// NOTE: IN_CREATE is ignored for files as it's followed by IN_CLOSE_WRITE once written.
+				if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE))
+				{
+					addUnique(&result, joinPath(pool, directory, event->name, (s32)strlen(event->name)), pool);
+				}
+			}
+			if (result.first != NULL)
+			{
+				// NOTE: Editors tend to save in bursts (write to a temporary file, rename, etc), so
+				//		 wait briefly for the rest of them rather than compiling twice.
+				timeout = 10;
+			}
+		}
+		return result;
+	}
+}
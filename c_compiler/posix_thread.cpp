@@ -0,0 +1,73 @@
+#include "thread.h"
+#include "memory.h"
+#include <pthread.h>
+#include <unistd.h>
+
+namespace Thread
+{
+	struct StartInfo {
+		Proc* proc;
+		void* data;
+	};
+
+	internal void* threadStart(void* startInfoLoose)
+	{
+		StartInfo startInfo = *(StartInfo*)startInfoLoose;
+		::free(startInfoLoose);
+		startInfo.proc(startInfo.data);
+		return NULL;
+	}
+
+	Handle create(Proc* proc, void* data)
+	{
+		StartInfo* startInfo = (StartInfo*)malloc(sizeof(StartInfo));
+		assert(startInfo != NULL);
+		startInfo->proc = proc;
+		startInfo->data = data;
+
+		pthread_t thread;
+		s32 error = pthread_create(&thread, NULL, threadStart, startInfo);
+		assert(error == 0);
+
+		Handle result = {};
+		result.platformHandle = (void*)thread;
+		return result;
+	}
+
+	void join(Handle thread)
+	{
+		pthread_join((pthread_t)thread.platformHandle, NULL);
+	}
+
+	s32 getProcessorCount()
+	{
+		s32 count = (s32)sysconf(_SC_NPROCESSORS_ONLN);
+		return (count > 0) ? count : 1;
+	}
+
+	s32 atomicIncrement(volatile s32* value)
+	{
+		return __sync_add_and_fetch(value, 1);
+	}
+
+	Mutex createMutex()
+	{
+		pthread_mutex_t* mutex = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
+		assert(mutex != NULL);
+		pthread_mutex_init(mutex, NULL);
+
+		Mutex result = {};
+		result.platformHandle = mutex;
+		return result;
+	}
+
+	void lock(Mutex mutex)
+	{
+		pthread_mutex_lock((pthread_mutex_t*)mutex.platformHandle);
+	}
+
+	void unlock(Mutex mutex)
+	{
+		pthread_mutex_unlock((pthread_mutex_t*)mutex.platformHandle);
+	}
+}
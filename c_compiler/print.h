@@ -9,6 +9,16 @@
 #include <stdarg.h>
 #include <math.h>
 
+// _itoa is MSVC-only, provide it for POSIX builds.
+#if !defined(_MSC_VER)
+inline char* _itoa(int value, char* buffer, int radix)
+{
+	assert(radix == 10);
+	sprintf(buffer, "%d", value);
+	return buffer;
+}
+#endif
+
 inline void print(char* format, ...)
 {
 	va_list valist;
@@ -44,7 +44,7 @@ public:
 			return result;
 		}
 
-		result.data = (char*)pushSize(totalLength, pool);
+		result.data = (char*)pushSizeUninitialized(totalLength, pool);
 		for (s32 s = 0; s < used; ++s)
 		{
 			String* string = &strings[s];
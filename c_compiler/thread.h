@@ -0,0 +1,52 @@
+#ifndef THREAD_INCLUDE
+#define THREAD_INCLUDE
+
+#include "types.h"
+#include <stdlib.h>
+
+// NOTE: Implemented per-platform in win32_thread.cpp / posix_thread.cpp so that
+//		 <windows.h> doesn't leak into the rest of the compiler.
+namespace Thread
+{
+	typedef void Proc(void* data);
+
+	struct Handle {
+		void* platformHandle;
+	};
+
+	Handle create(Proc* proc, void* data);
+	void join(Handle thread);
+	s32 getProcessorCount();
+
+	// Returns the incremented value
+	s32 atomicIncrement(volatile s32* value);
+
+	struct Mutex {
+		void* platformHandle;
+	};
+
+	Mutex createMutex();
+	void lock(Mutex mutex);
+	void unlock(Mutex mutex);
+
+	// Runs 'proc' once for each item in 'workerData' and waits for them all to finish.
+	// The first worker runs on the calling thread.
+	inline void runWorkers(Proc* proc, void** workerData, s32 workerCount)
+	{
+		assert(workerCount > 0);
+		Handle* threads = (Handle*)malloc(sizeof(Handle) * workerCount);
+		assert(threads != NULL);
+		for (s32 i = 1; i < workerCount; ++i)
+		{
+			threads[i] = create(proc, workerData[i]);
+		}
+		proc(workerData[0]);
+		for (s32 i = 1; i < workerCount; ++i)
+		{
+			join(threads[i]);
+		}
+		free(threads);
+	}
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "string.h"
 #include "array.h"
+#include "atom.h"
 
 enum TokenType {
 	TOKEN_UNKNOWN = 0,
@@ -43,8 +44,9 @@ enum TokenType {
 
 struct Token : String {
 	TokenType type;
+	Atom atom; // Set for TOKEN_IDENTIFIER
 	u32 lineNumber;
-	String pathName;
+	u16 fileId; // Index into 'Compiler::filePathnames'
 	inline bool isOperator()
 	{
 		return (type == TOKEN_EQUAL || type == TOKEN_OR || type == TOKEN_AND
@@ -91,4 +93,18 @@ struct Token : String {
 	}
 };
 
+// Find token with the same name, ie. variable/parameter names
+inline s32 findByAtom(Array<Token>* tokens, Atom atom)
+{
+	assert(atom != ATOM_NONE);
+	for (s32 i = 0; i < tokens->used; ++i)
+	{
+		if (tokens->data[i].atom == atom)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
 #endif
\ No newline at end of file
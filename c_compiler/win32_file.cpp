@@ -3,6 +3,106 @@
 #include "win32_string.h"
 #include <strsafe.h>
 
+namespace File
+{
+	// todo: Use CreateFileMapping/MapViewOfFile, for now just copy into memory.
+	String mapEntireFile(String filename, Error* error, bool writable)
+	{
+		// NOTE: Always writable as it's a private copy
+		return readEntireFile(filename, error);
+	}
+
+	void unmapEntireFile(String contents)
+	{
+		// NOTE: 'readEntireFile' uses malloc
+		free(contents.data);
+	}
+
+	bool exists(String filename)
+	{
+		char cFilename[MAX_PATH];
+		filename.toCString(cFilename, ArrayCount(cFilename));
+		DWORD attributes = GetFileAttributesA(cFilename);
+		return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+	}
+
+	inline internal bool toStreamTempPath(String filename, char* dest, s32 destLength)
+	{
+		if (filename.length + 5 > destLength)
+		{
+			return false;
+		}
+		filename.toCString(dest, destLength);
+		memcpy(dest + filename.length, ".tmp", 5);
+		return true;
+	}
+
+	Stream openStream(String filename, Error* error)
+	{
+		if (error) {
+			zeroMemory(error, sizeof(File::Error));
+		}
+		Stream stream = {};
+		char cTempPath[MAX_PATH];
+		HANDLE handle = INVALID_HANDLE_VALUE;
+		if (toStreamTempPath(filename, cTempPath, ArrayCount(cTempPath)))
+		{
+			handle = CreateFileA(cTempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		}
+		else
+		{
+			SetLastError(ERROR_FILENAME_EXCED_RANGE);
+		}
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			print("openStream:: Unable to open file for writing. File = %s, error = %d\n", &filename, (s32)GetLastError());
+			if (error) {
+				error->errorCode = FILE_CANT_OPEN;
+			}
+			return stream;
+		}
+		stream.platformHandle = handle;
+		stream.filename = filename;
+		return stream;
+	}
+
+	// todo: Use WriteFileGather, it needs unbuffered page-aligned writes so just write each part for now.
+	void writeStream(Stream* stream, String* parts, s32 partCount)
+	{
+		assert(stream->platformHandle != NULL);
+		for (s32 i = 0; i < partCount && !stream->hasError; ++i)
+		{
+			DWORD bytesWritten = 0;
+			if (parts[i].length > 0
+				&& (!WriteFile((HANDLE)stream->platformHandle, parts[i].data, parts[i].length, &bytesWritten, NULL) || bytesWritten != (DWORD)parts[i].length))
+			{
+				stream->hasError = true;
+			}
+		}
+	}
+
+	bool closeStream(Stream* stream)
+	{
+		assert(stream->platformHandle != NULL);
+		stream->hasError = !CloseHandle((HANDLE)stream->platformHandle) || stream->hasError;
+		stream->platformHandle = NULL;
+
+		char cFilename[MAX_PATH];
+		char cTempPath[MAX_PATH];
+		stream->filename.toCString(cFilename, ArrayCount(cFilename));
+		toStreamTempPath(stream->filename, cTempPath, ArrayCount(cTempPath));
+		if (!stream->hasError && !MoveFileExA(cTempPath, cFilename, MOVEFILE_REPLACE_EXISTING))
+		{
+			stream->hasError = true;
+		}
+		if (stream->hasError)
+		{
+			DeleteFileA(cTempPath);
+		}
+		return !stream->hasError;
+	}
+}
+
 namespace Directory
 {
 	StringLinkedList getFilesRecursive(AllocatorPool* pool, String directory, Error* error)
@@ -99,4 +199,110 @@ namespace Directory
 		}
 		return list;
 	}
+
+	bool create(String directory)
+	{
+		char cDirectory[MAX_PATH];
+		if (directory.length >= (s32)ArrayCount(cDirectory))
+		{
+			return false;
+		}
+		directory.toCString(cDirectory, ArrayCount(cDirectory));
+		if (CreateDirectoryA(cDirectory, NULL))
+		{
+			return true;
+		}
+		return GetLastError() == ERROR_ALREADY_EXISTS;
+	}
+
+	struct Watcher {
+		HANDLE handle;
+		String directory;
+	};
+
+	Watcher* watch(String directory, AllocatorPool* pool)
+	{
+		if (directory.length > 1 && (directory.data[directory.length - 1] == '/' || directory.data[directory.length - 1] == '\\'))
+		{
+			// Trim trailing back-or-forward slash
+			directory.length -= 1;
+		}
+		char cDirectory[MAX_PATH];
+		directory.toCString(cDirectory, ArrayCount(cDirectory));
+		HANDLE handle = CreateFileA(cDirectory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			return NULL;
+		}
+		Watcher* watcher = pushStruct(Watcher, pool);
+		watcher->handle = handle;
+		watcher->directory = directory;
+		return watcher;
+	}
+
+	StringLinkedList waitForChanges(Watcher* watcher, AllocatorPool* pool, Error* error)
+	{
+		if (error) {
+			zeroMemory(error, sizeof(Directory::Error));
+		}
+		// NOTE: Must be DWORD aligned for ReadDirectoryChangesW
+		DWORD buffer[Kilobytes(16) / sizeof(DWORD)];
+		StringLinkedList result = {};
+		while (result.first == NULL)
+		{
+			// NOTE: Changes made between calls are queued by the handle so nothing is missed.
+			DWORD bytesRead = 0;
+			if (!ReadDirectoryChangesW(watcher->handle, buffer, sizeof(buffer), TRUE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE, &bytesRead, NULL, NULL))
+			{
+				if (error) {
+					error->errorCode = DIRECTORY_CANT_WATCH;
+				}
+				break;
+			}
+			if (bytesRead == 0)
+			{
+				// NOTE: More changes than fit in 'buffer', they're lost so wait for the next ones.
+				break;
+			}
+			char* at = (char*)buffer;
+			for (;;)
+			{
+				FILE_NOTIFY_INFORMATION* info = (FILE_NOTIFY_INFORMATION*)at;
+				wchar_t filename[MAX_PATH];
+				s32 filenameLength = info->FileNameLength / sizeof(wchar_t);
+				if (filenameLength >= MAX_PATH)
+				{
+					filenameLength = MAX_PATH - 1;
+				}
+				memcpy(filename, info->FileName, filenameLength * sizeof(wchar_t));
+				filename[filenameLength] = L'\0';
+				String name = WcharToUTF8String(pool, filename);
+
+				// Join with the watched directory
+				String path = {};
+				path.length = watcher->directory.length + 1 + name.length;
+				path.data = (char*)pushSize(path.length + 1, pool);
+				memcpy(path.data, watcher->directory.data, watcher->directory.length);
+				path.data[watcher->directory.length] = '\\';
+				memcpy(path.data + watcher->directory.length + 1, name.data, name.length);
+
+				bool isDuplicate = false;
+				for (StringLinkedListNode* node = result.first; node != NULL; node = node->next)
+				{
+					isDuplicate = isDuplicate || node->string.cmp(path);
+				}
+				if (!isDuplicate)
+				{
+					result.add(path, pool);
+				}
+
+				if (info->NextEntryOffset == 0)
+				{
+					break;
+				}
+				at += info->NextEntryOffset;
+			}
+		}
+		return result;
+	}
 }
\ No newline at end of file
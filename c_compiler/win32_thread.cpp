@@ -0,0 +1,74 @@
+#include "thread.h"
+#include "memory.h"
+#include <windows.h>
+
+namespace Thread
+{
+	struct StartInfo {
+		Proc* proc;
+		void* data;
+	};
+
+	internal DWORD WINAPI threadStart(LPVOID startInfoLoose)
+	{
+		StartInfo startInfo = *(StartInfo*)startInfoLoose;
+		::free(startInfoLoose);
+		startInfo.proc(startInfo.data);
+		return 0;
+	}
+
+	Handle create(Proc* proc, void* data)
+	{
+		StartInfo* startInfo = (StartInfo*)malloc(sizeof(StartInfo));
+		assert(startInfo != NULL);
+		startInfo->proc = proc;
+		startInfo->data = data;
+
+		HANDLE thread = CreateThread(NULL, 0, threadStart, startInfo, 0, NULL);
+		assert(thread != NULL);
+
+		Handle result = {};
+		result.platformHandle = thread;
+		return result;
+	}
+
+	void join(Handle thread)
+	{
+		WaitForSingleObject((HANDLE)thread.platformHandle, INFINITE);
+		CloseHandle((HANDLE)thread.platformHandle);
+	}
+
+	s32 getProcessorCount()
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		s32 count = (s32)systemInfo.dwNumberOfProcessors;
+		return (count > 0) ? count : 1;
+	}
+
+	s32 atomicIncrement(volatile s32* value)
+	{
+		return (s32)InterlockedIncrement((volatile LONG*)value);
+	}
+
+	Mutex createMutex()
+	{
+		CRITICAL_SECTION* mutex = (CRITICAL_SECTION*)malloc(sizeof(CRITICAL_SECTION));
+		assert(mutex != NULL);
+		InitializeCriticalSection(mutex);
+
+		Mutex result = {};
+		result.platformHandle = mutex;
+		return result;
+	}
+
+	void lock(Mutex mutex)
+	{
+		EnterCriticalSection((CRITICAL_SECTION*)mutex.platformHandle);
+	}
+
+	void unlock(Mutex mutex)
+	{
+		LeaveCriticalSection((CRITICAL_SECTION*)mutex.platformHandle);
+	}
+}